@@ -0,0 +1,189 @@
+#include "bigfixed.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+// long division of the limbs (top one included) by 10
+static void divide_by_10(std::vector<uint32_t>& limbs) {
+	uint64_t remainder = 0;
+	for (size_t l = limbs.size(); l-- > 0;) {
+		const uint64_t current = (remainder << 32) | limbs[l];
+		limbs[l] = uint32_t(current / 10);
+		remainder = current % 10;
+	}
+}
+
+BigFixed::BigFixed(int fractionBits)
+		: limbs(size_t((std::max(fractionBits, 0) + 31) / 32 + 1), 0) {
+}
+
+bool BigFixed::parse(const std::string& text, int fractionBits, BigFixed& value) {
+	value = BigFixed(fractionBits);
+
+	size_t pos = 0;
+	bool minus = false;
+	if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+		minus = text[pos] == '-';
+		++pos;
+	}
+
+	// pull the digits out, remembering where the point was
+	std::string digits;
+	int pointAt = -1;
+	for (; pos < text.size(); ++pos) {
+		const char c = text[pos];
+		if (std::isdigit((unsigned char)c)) {
+			digits += c;
+		} else if (c == '.' && pointAt < 0) {
+			pointAt = int(digits.size());
+		} else {
+			break;
+		}
+	}
+	if (digits.empty()) {
+		return false;
+	}
+	if (pointAt < 0) {
+		pointAt = int(digits.size());
+	}
+
+	// an exponent just moves the point
+	if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+		char* end = nullptr;
+		const long exponent = std::strtol(text.c_str() + pos + 1, &end, 10);
+		if (end == text.c_str() + pos + 1 || *end != '\0' || exponent > 100000 || exponent < -100000) {
+			return false;
+		}
+		pointAt += int(exponent);
+	} else if (pos != text.size()) {
+		return false;
+	}
+
+	// whole number part, which has to fit in the top limb
+	uint64_t whole = 0;
+	for (int i = 0; i < pointAt; ++i) {
+		whole = whole * 10 + uint64_t(i < int(digits.size()) ? digits[size_t(i)] - '0' : 0);
+		if (whole >= (uint64_t(1) << 31)) {
+			return false;
+		}
+	}
+
+	// the fraction is built up from its last digit, putting each digit in front of what's there and dividing by 10
+	// (the top limb is borrowed to hold the digit while the whole thing is divided)
+	std::vector<uint32_t>& limbs = value.limbs;
+	for (int i = int(digits.size()) - 1; i >= std::max(pointAt, 0); --i) {
+		limbs.back() = uint32_t(digits[size_t(i)] - '0');
+		divide_by_10(limbs);
+	}
+	// if the point was in front of the digits, every missing leading zero is another divide by 10
+	for (int i = pointAt; i < 0; ++i) {
+		divide_by_10(limbs);
+	}
+	limbs.back() = uint32_t(whole);
+
+	if (minus) {
+		value = value.negated();
+	}
+	return true;
+}
+
+BigFixed BigFixed::from_double(double value, int fractionBits) {
+	BigFixed result(fractionBits);
+	const double magnitude = std::fabs(value);
+	double whole = std::floor(magnitude);
+	result.limbs.back() = uint32_t(whole);
+
+	// peel 32 bits off the fraction at a time, every step is exact for a double
+	double fraction = magnitude - whole;
+	for (size_t l = result.limbs.size() - 1; l-- > 0 && fraction != 0.0;) {
+		fraction = std::ldexp(fraction, 32);
+		whole = std::floor(fraction);
+		result.limbs[l] = uint32_t(whole);
+		fraction -= whole;
+	}
+	return value < 0.0 ? result.negated() : result;
+}
+
+BigFixed BigFixed::operator+(const BigFixed& other) const {
+	BigFixed result = *this;
+	uint64_t carry = 0;
+	for (size_t i = 0; i < limbs.size(); ++i) {
+		const uint64_t sum = uint64_t(limbs[i]) + other.limbs[i] + carry;
+		result.limbs[i] = uint32_t(sum);
+		carry = sum >> 32;
+	}
+	return result;
+}
+
+BigFixed BigFixed::operator-(const BigFixed& other) const {
+	BigFixed result = *this;
+	uint64_t borrow = 0;
+	for (size_t i = 0; i < limbs.size(); ++i) {
+		const uint64_t difference = uint64_t(limbs[i]) - other.limbs[i] - borrow;
+		result.limbs[i] = uint32_t(difference);
+		borrow = (difference >> 32) & 1;
+	}
+	return result;
+}
+
+BigFixed BigFixed::operator*(const BigFixed& other) const {
+	// multiply the magnitudes and sort the sign out at the end
+	const bool minus = negative() != other.negative();
+	const BigFixed a = negative() ? negated() : *this;
+	const BigFixed b = other.negative() ? other.negated() : other;
+
+	const size_t n = limbs.size();
+	std::vector<uint32_t> product(2 * n, 0);
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t carry = 0;
+		for (size_t j = 0; j < n; ++j) {
+			const uint64_t current = uint64_t(a.limbs[i]) * b.limbs[j] + product[i + j] + carry;
+			product[i + j] = uint32_t(current);
+			carry = current >> 32;
+		}
+		product[i + n] = uint32_t(carry);
+	}
+
+	// both had n - 1 limbs of fraction, so the product has 2n - 2 and the bottom n - 1 get dropped
+	BigFixed result = *this;
+	for (size_t i = 0; i < n; ++i) {
+		result.limbs[i] = product[i + n - 1];
+	}
+	return minus ? result.negated() : result;
+}
+
+BigFixed BigFixed::twice() const {
+	BigFixed result = *this;
+	uint32_t carry = 0;
+	for (size_t i = 0; i < limbs.size(); ++i) {
+		result.limbs[i] = (limbs[i] << 1) | carry;
+		carry = limbs[i] >> 31;
+	}
+	return result;
+}
+
+double BigFixed::to_double() const {
+	if (negative()) {
+		return -negated().to_double();
+	}
+	// least significant limb first so the small bits aren't lost
+	const int fractionLimbs = int(limbs.size()) - 1;
+	double result = 0.0;
+	for (int i = 0; i <= fractionLimbs; ++i) {
+		result += std::ldexp(double(limbs[size_t(i)]), 32 * (i - fractionLimbs));
+	}
+	return result;
+}
+
+BigFixed BigFixed::negated() const {
+	BigFixed result = *this;
+	uint64_t carry = 1;
+	for (size_t i = 0; i < limbs.size(); ++i) {
+		const uint64_t sum = uint64_t(~limbs[i]) + carry;
+		result.limbs[i] = uint32_t(sum);
+		carry = sum >> 32;
+	}
+	return result;
+}
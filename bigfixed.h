@@ -0,0 +1,45 @@
+// Arbitrary precision fixed-point numbers for the deep zoom reference orbit
+// A number is a two's complement integer spread over 32-bit limbs (least significant first), with the top limb
+// holding the whole number part and the rest the fraction, so it can hold anything between -2^31 and 2^31.
+// Only what the reference orbit needs is here: parsing, adding, subtracting, multiplying and turning into a double.
+
+#ifndef MANDELBROT_BIGFIXED_H
+#define MANDELBROT_BIGFIXED_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class BigFixed {
+public:
+	// zero, with fractionBits bits after the point (rounded up to whole limbs)
+	explicit BigFixed(int fractionBits = 0);
+
+	// parses a decimal like "-0.743643887037158704752191506114774" or "1.5e-3"
+	// returns false if it isn't a number or the whole number part is too big
+	static bool parse(const std::string& text, int fractionBits, BigFixed& value);
+
+	// a double exactly (bits past fractionBits are dropped), it has to fit in the top limb the same as parse
+	static BigFixed from_double(double value, int fractionBits);
+
+	// both sides need the same precision
+	BigFixed operator+(const BigFixed& other) const;
+	BigFixed operator-(const BigFixed& other) const;
+	BigFixed operator*(const BigFixed& other) const; // the result is truncated to the same precision
+
+	// doubles the value, cheaper than adding it to itself
+	BigFixed twice() const;
+
+	// the nearest double (well, within an ulp or so)
+	double to_double() const;
+
+	bool negative() const { return int32_t(limbs.back()) < 0; }
+	int fractionBits() const { return int(limbs.size() - 1) * 32; }
+
+private:
+	BigFixed negated() const;
+
+	std::vector<uint32_t> limbs; // limbs.back() is the whole number part
+};
+
+#endif //MANDELBROT_BIGFIXED_H
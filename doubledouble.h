@@ -0,0 +1,76 @@
+// Double-double numbers: an unevaluated sum of two doubles, hi + lo, with |lo| no more than half an ulp of hi
+// That gives about 106 bits of mantissa (against 53 for a double) for not much more than 10 times the work,
+// which covers the zooms between where doubles run out and where perturbation is needed.
+// The error-free sums and products rely on the compiler not fusing or reordering them, kernel.cpp is built with
+// -ffp-contract=off for that (and nothing here is any use with -ffast-math).
+
+#ifndef MANDELBROT_DOUBLEDOUBLE_H
+#define MANDELBROT_DOUBLEDOUBLE_H
+
+struct DoubleDouble {
+	double hi;
+	double lo;
+
+	DoubleDouble() : hi(0.0), lo(0.0) {}
+	DoubleDouble(double value) : hi(value), lo(0.0) {}
+	DoubleDouble(double high, double low) : hi(high), lo(low) {}
+};
+
+// a + b exactly, as a rounded sum and the error
+inline DoubleDouble two_sum(double a, double b) {
+	const double sum = a + b;
+	const double bb = sum - a;
+	return DoubleDouble(sum, (a - (sum - bb)) + (b - bb));
+}
+
+// same again when |a| >= |b| is already known
+inline DoubleDouble quick_two_sum(double a, double b) {
+	const double sum = a + b;
+	return DoubleDouble(sum, b - (sum - a));
+}
+
+// a * b exactly, using Dekker's split of each side into two 26-bit halves
+inline DoubleDouble two_prod(double a, double b) {
+	const double splitter = 134217729.0; // 2^27 + 1
+	const double ta = splitter * a;
+	const double aHi = ta - (ta - a);
+	const double aLo = a - aHi;
+	const double tb = splitter * b;
+	const double bHi = tb - (tb - b);
+	const double bLo = b - bHi;
+	const double product = a * b;
+	return DoubleDouble(product, ((aHi * bHi - product) + aHi * bLo + aLo * bHi) + aLo * bLo);
+}
+
+inline DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b) {
+	DoubleDouble sum = two_sum(a.hi, b.hi);
+	const DoubleDouble low = two_sum(a.lo, b.lo);
+	sum.lo += low.hi;
+	sum = quick_two_sum(sum.hi, sum.lo);
+	sum.lo += low.lo;
+	return quick_two_sum(sum.hi, sum.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a) {
+	return DoubleDouble(-a.hi, -a.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b) {
+	return a + -b;
+}
+
+inline DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b) {
+	DoubleDouble product = two_prod(a.hi, b.hi);
+	product.lo += a.hi * b.lo + a.lo * b.hi;
+	return quick_two_sum(product.hi, product.lo);
+}
+
+inline bool operator<(const DoubleDouble& a, const DoubleDouble& b) {
+	return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+inline bool operator<=(const DoubleDouble& a, const DoubleDouble& b) {
+	return !(b < a);
+}
+
+#endif //MANDELBROT_DOUBLEDOUBLE_H
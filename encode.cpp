@@ -0,0 +1,419 @@
+#include "encode.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "perfcounters.h"
+#include "trace.h"
+
+#ifdef MANDELBROT_HAVE_PNG
+#include "png.h"
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MANDELBROT_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MANDELBROT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define TARGET_SSSE3
+#endif
+
+bool parse_format(const std::string& text, OutputFormat& format) {
+	if (text == "tga") {
+		format = OutputFormat::TGA;
+	} else if (text == "rle-tga") {
+		format = OutputFormat::RLETGA;
+	} else if (text == "png") {
+		format = OutputFormat::PNG;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char* format_name(OutputFormat format) {
+	switch (format) {
+		case OutputFormat::RLETGA: return "RLE TGA";
+		case OutputFormat::PNG: return "PNG";
+		default: return "TGA";
+	}
+}
+
+const char* format_extension(OutputFormat format) {
+	return format == OutputFormat::PNG ? ".png" : ".tga";
+}
+
+bool format_supported(OutputFormat format) {
+#ifdef MANDELBROT_HAVE_PNG
+	(void)format;
+	return true;
+#else
+	return format != OutputFormat::PNG;
+#endif
+}
+
+bool fits_tga(int width, int height) {
+	return width <= 0xFFFF && height <= 0xFFFF;
+}
+
+void write_tga_header(uint8_t* header, int width, int height, bool rle) {
+	const uint8_t fields[tgaHeaderSize] = {
+		0, //no image ID
+		0, //no colour map
+		uint8_t(rle ? 10 : 2), //run-length encoded or uncompressed 24-bit image
+		0, 0, 0, 0, 0, //empty colour map specification
+		0, 0, //X origin
+		0, 0, //Y origin
+		uint8_t(width & 0xFF), uint8_t(width >> 8 & 0xFF), //width
+		uint8_t(height & 0xFF), uint8_t(height >> 8 & 0xFF), //height
+		24, //bits per pixel
+		0x20, //image descriptor: top left origin, the rows go top to bottom like the framebuffer
+	};
+	memcpy(header, fields, tgaHeaderSize);
+}
+
+void write_tga_header(std::ostream& outfile, int width, int height, bool rle) {
+	uint8_t header[tgaHeaderSize];
+	write_tga_header(header, width, height, rle);
+	outfile.write((const char*)header, tgaHeaderSize);
+}
+
+void write_ppm_header(std::ostream& outfile, int width, int height) {
+	outfile << "P6\n" << width << " " << height << "\n255\n";
+}
+
+static void pack_pixels_scalar(const uint32_t* pixels, int count, uint8_t* out, bool rgb) {
+	for (int i = 0; i < count; ++i) {
+		const uint32_t x = pixels[i];
+		const uint8_t blue = static_cast<uint8_t>(x & 0xFF);
+		const uint8_t green = static_cast<uint8_t>(x >> 8 & 0xFF);
+		const uint8_t red = static_cast<uint8_t>(x >> 16 & 0xFF);
+		out[0] = rgb ? red : blue;
+		out[1] = green;
+		out[2] = rgb ? blue : red;
+		out += 3;
+	}
+}
+
+#ifdef MANDELBROT_X86
+
+// 4 pixels (16 bytes) in, 12 bytes out, the shuffle just drops the unused top byte of each pixel
+// (and swaps red and blue for PPM)
+TARGET_SSSE3 static void pack_pixels_ssse3(const uint32_t* pixels, int count, uint8_t* out, bool rgb) {
+	const __m128i shuffle = rgb
+			? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+			: _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+	// each store is 16 bytes wide but only 12 are kept, so stop early enough not to run off the end
+	int i = 0;
+	for (; i + 6 <= count; i += 4) {
+		const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 3), _mm_shuffle_epi8(in, shuffle));
+	}
+	pack_pixels_scalar(pixels + i, count - i, out + i * 3, rgb);
+}
+
+static bool cpu_has_ssse3() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+static const bool haveSsse3 = cpu_has_ssse3();
+
+#endif // MANDELBROT_X86
+
+void pack_pixels(const uint32_t* pixels, int count, uint8_t* out, bool rgb) {
+#ifdef MANDELBROT_X86
+	if (haveSsse3) {
+		pack_pixels_ssse3(pixels, count, out, rgb);
+		return;
+	}
+#endif
+	pack_pixels_scalar(pixels, count, out, rgb);
+}
+
+void write_rows(std::ostream& outfile, const Framebuffer& image, int rows, bool ppm) {
+	const int width = image.width();
+	std::vector<uint8_t> packed(size_t(width) * 3);
+	for (int y = 0; y < rows; ++y) {
+		pack_pixels(image.row(y), width, packed.data(), ppm);
+		outfile.write((const char*)packed.data(), std::streamsize(packed.size()));
+	}
+}
+
+// a packet is a header byte then either one pixel repeated (high bit set) or up to 128 raw pixels,
+// so the worst case (nothing repeats) costs one extra byte per 128 pixels
+size_t rle_max_bytes(int count) {
+	return size_t(count) * 3 + (size_t(count) + 127) / 128;
+}
+
+size_t encode_rle_row(const uint32_t* pixels, int count, uint8_t* out) {
+	const int maxPacket = 128;
+	uint8_t* start = out;
+
+	int i = 0;
+	while (i < count) {
+		// how many times does this pixel repeat?
+		int run = 1;
+		while (i + run < count && run < maxPacket && pixels[i + run] == pixels[i]) {
+			++run;
+		}
+
+		if (run > 1) {
+			*out++ = uint8_t(0x80 | (run - 1));
+			pack_pixels(pixels + i, 1, out, false);
+			out += 3;
+			i += run;
+			continue;
+		}
+
+		// raw packet, carry on until two pixels in a row match (that's where the next run starts)
+		int raw = 1;
+		while (i + raw < count && raw < maxPacket
+		       && !(i + raw + 1 < count && pixels[i + raw] == pixels[i + raw + 1])) {
+			++raw;
+		}
+		*out++ = uint8_t(raw - 1);
+		pack_pixels(pixels + i, raw, out, false);
+		out += size_t(raw) * 3;
+		i += raw;
+	}
+
+	return size_t(out - start);
+}
+
+void write_rows_rle(std::ostream& outfile, const Framebuffer& image, int rows) {
+	const int width = image.width();
+	std::vector<uint8_t> packed(rle_max_bytes(width));
+	for (int y = 0; y < rows; ++y) {
+		const size_t bytes = encode_rle_row(image.row(y), width, packed.data());
+		outfile.write((const char*)packed.data(), std::streamsize(bytes));
+	}
+}
+
+// splits rows [0, rows) into one contiguous chunk per thread and runs work(chunk, firstRow, endRow) on each
+// (as tasks on the pool if there is one, otherwise on threads of their own)
+template <typename Work>
+static void for_row_chunks(int threads, int rows, ThreadPool* pool, Work work) {
+	threads = std::max(1, std::min(threads, rows));
+	if (pool != nullptr) {
+		TaskGroup group(*pool);
+		for (int i = 0; i < threads; ++i) {
+			const int y0 = int(int64_t(rows) * i / threads);
+			const int y1 = int(int64_t(rows) * (i + 1) / threads);
+			group.run([work, i, y0, y1]() {
+				TraceScope scope("encode rows");
+				PerfScope counters(PerfPhase::Encode);
+				work(i, y0, y1);
+			});
+		}
+		group.wait();
+		return;
+	}
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threads; ++i) {
+		const int y0 = int(int64_t(rows) * i / threads);
+		const int y1 = int(int64_t(rows) * (i + 1) / threads);
+		workers.emplace_back(work, i, y0, y1);
+	}
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+#ifdef MANDELBROT_POSIX
+// pwrite can write less than it was asked to, so keep going until it's all out
+static bool pwrite_all(int fd, const uint8_t* data, size_t bytes, off_t offset) {
+	while (bytes > 0) {
+		const ssize_t written = pwrite(fd, data, bytes, offset);
+		if (written <= 0) {
+			return false;
+		}
+		data += written;
+		bytes -= size_t(written);
+		offset += written;
+	}
+	return true;
+}
+#endif
+
+bool write_tga(const std::string& name, const Framebuffer& image, int threads, ThreadPool* pool) {
+	const int width = image.width();
+	const int height = image.height();
+	if (!fits_tga(width, height)) {
+		return false;
+	}
+
+	const size_t rowBytes = size_t(width) * 3;
+	const size_t total = tgaHeaderSize + rowBytes * size_t(height);
+
+	uint8_t header[tgaHeaderSize];
+	write_tga_header(header, width, height);
+
+#ifdef MANDELBROT_POSIX
+	const int fd = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+
+	// reserve the blocks up front where we can, so running out of disk shows up here
+	// rather than as a SIGBUS halfway through writing into the mapping
+	bool ok = false;
+#ifdef __linux__
+	ok = posix_fallocate(fd, 0, off_t(total)) == 0;
+#endif
+	if (!ok) {
+		ok = ftruncate(fd, off_t(total)) == 0;
+	}
+
+	void* mapping = ok ? mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	if (mapping != MAP_FAILED) {
+		// zero copy, each thread packs its rows straight into the file's pages
+		uint8_t* out = static_cast<uint8_t*>(mapping);
+		memcpy(out, header, tgaHeaderSize);
+		for_row_chunks(threads, height, pool, [&image, out, rowBytes, width](int, int y0, int y1) {
+			for (int y = y0; y < y1; ++y) {
+				pack_pixels(image.row(y), width, out + tgaHeaderSize + size_t(y) * rowBytes, false);
+			}
+		});
+		ok = munmap(mapping, total) == 0;
+	} else if (ok) {
+		// couldn't map it, so each thread packs a few rows at a time and pwrites them to where they go in the file
+		std::atomic<bool> failed(!pwrite_all(fd, header, tgaHeaderSize, 0));
+		for_row_chunks(threads, height, pool, [&image, &failed, fd, rowBytes, width](int, int y0, int y1) {
+			const int batch = 64;
+			std::vector<uint8_t> packed(rowBytes * batch);
+			for (int y = y0; y < y1 && !failed; y += batch) {
+				const int rows = std::min(batch, y1 - y);
+				for (int r = 0; r < rows; ++r) {
+					pack_pixels(image.row(y + r), width, packed.data() + size_t(r) * rowBytes, false);
+				}
+				const off_t offset = off_t(tgaHeaderSize + size_t(y) * rowBytes);
+				if (!pwrite_all(fd, packed.data(), rowBytes * size_t(rows), offset)) {
+					failed = true;
+				}
+			}
+		});
+		ok = !failed;
+	}
+
+	if (close(fd) != 0) {
+		ok = false;
+	}
+	return ok;
+#else
+	// no mmap or pwrite here, so pack everything in parallel and write it out in one go
+	std::vector<uint8_t> data(total);
+	memcpy(data.data(), header, tgaHeaderSize);
+	uint8_t* out = data.data();
+	for_row_chunks(threads, height, pool, [&image, out, rowBytes, width](int, int y0, int y1) {
+		for (int y = y0; y < y1; ++y) {
+			pack_pixels(image.row(y), width, out + tgaHeaderSize + size_t(y) * rowBytes, false);
+		}
+	});
+
+	std::ofstream outfile(name, std::ofstream::binary);
+	outfile.write((const char*)data.data(), std::streamsize(total));
+	outfile.close();
+	return bool(outfile);
+#endif
+}
+
+bool write_tga_rle(const std::string& name, const Framebuffer& image, int threads, size_t* bytesWritten, ThreadPool* pool) {
+	const int width = image.width();
+	const int height = image.height();
+	if (!fits_tga(width, height)) {
+		return false;
+	}
+
+	// every thread encodes its own block of rows into its own buffer...
+	std::vector<std::vector<uint8_t>> blocks(size_t(std::max(1, std::min(threads, height))));
+	for_row_chunks(threads, height, pool, [&image, &blocks, width](int block, int y0, int y1) {
+		std::vector<uint8_t>& encoded = blocks[size_t(block)];
+		encoded.resize(rle_max_bytes(width) * size_t(y1 - y0));
+		size_t used = 0;
+		for (int y = y0; y < y1; ++y) {
+			used += encode_rle_row(image.row(y), width, encoded.data() + used);
+		}
+		encoded.resize(used);
+	});
+
+	// ...and then they get written out one after the other
+	std::ofstream outfile(name, std::ofstream::binary);
+	write_tga_header(outfile, width, height, true);
+	size_t total = tgaHeaderSize;
+	for (const auto& encoded : blocks) {
+		outfile.write((const char*)encoded.data(), std::streamsize(encoded.size()));
+		total += encoded.size();
+	}
+	outfile.close();
+
+	if (bytesWritten != nullptr) {
+		*bytesWritten = total;
+	}
+	return bool(outfile);
+}
+
+bool write_image(const std::string& name, const Framebuffer& image, OutputFormat format, int threads,
+                 size_t* bytesWritten, ThreadPool* pool) {
+	switch (format) {
+		case OutputFormat::RLETGA:
+			return write_tga_rle(name, image, threads, bytesWritten, pool);
+		case OutputFormat::PNG:
+#ifdef MANDELBROT_HAVE_PNG
+			return write_png(name, image, threads, bytesWritten, pool);
+#else
+			return false;
+#endif
+		default:
+			if (!write_tga(name, image, threads, pool)) {
+				return false;
+			}
+			if (bytesWritten != nullptr) {
+				*bytesWritten = tgaHeaderSize + size_t(image.width()) * image.height() * 3;
+			}
+			return true;
+	}
+}
+
+bool encode_image(std::ostream& outfile, const Framebuffer& image, OutputFormat format, int threads) {
+	switch (format) {
+		case OutputFormat::RLETGA:
+			write_tga_header(outfile, image.width(), image.height(), true);
+			write_rows_rle(outfile, image, image.height());
+			return bool(outfile);
+		case OutputFormat::PNG:
+#ifdef MANDELBROT_HAVE_PNG
+			return write_png(outfile, image, threads);
+#else
+			return false;
+#endif
+		default:
+			write_tga_header(outfile, image.width(), image.height());
+			write_rows(outfile, image, image.height(), false);
+			return bool(outfile);
+	}
+}
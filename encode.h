@@ -0,0 +1,73 @@
+// Writing the framebuffer out to image files
+// The TGA writer packs rows on several threads straight into a memory-mapped output file
+// (or pwrites them at their offsets if the file can't be mapped), rather than 3 bytes at a time.
+// The RLE TGA writer run-length encodes blocks of rows on several threads and then glues them together.
+// PNG lives in png.cpp, write_image() picks between them.
+
+#ifndef MANDELBROT_ENCODE_H
+#define MANDELBROT_ENCODE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "framebuffer.h"
+#include "threadpool.h"
+
+const int tgaHeaderSize = 18;
+
+// the file formats a render can be saved as
+enum class OutputFormat {
+	TGA, // uncompressed
+	RLETGA, // run-length encoded
+	PNG, // deflated, only if the build found zlib
+};
+
+// "tga", "rle-tga" or "png", returns false for anything else
+bool parse_format(const std::string& text, OutputFormat& format);
+const char* format_name(OutputFormat format);
+const char* format_extension(OutputFormat format);
+
+// false if this build can't write the format (PNG without zlib)
+bool format_supported(OutputFormat format);
+
+// the TGA header only has 16 bits for each dimension
+bool fits_tga(int width, int height);
+
+// TGA header for a 24-bit image, uncompressed (type 2) or run-length encoded (type 10)
+void write_tga_header(uint8_t* header, int width, int height, bool rle = false);
+void write_tga_header(std::ostream& outfile, int width, int height, bool rle = false);
+
+// binary PPM header, used for images too big for a TGA header
+void write_ppm_header(std::ostream& outfile, int width, int height);
+
+// turns 0xRRGGBB pixels into 3 bytes each, blue/green/red for TGA or red/green/blue for PPM
+// (uses SSSE3 byte shuffles when the CPU has them)
+void pack_pixels(const uint32_t* pixels, int count, uint8_t* out, bool rgb);
+
+// run-length encodes one row into TGA packets (they never cross rows), out needs room for rle_max_bytes(count)
+// returns how many bytes were written
+size_t encode_rle_row(const uint32_t* pixels, int count, uint8_t* out);
+size_t rle_max_bytes(int count);
+
+// writes the first rows rows of the image to a stream, one write per row
+void write_rows(std::ostream& outfile, const Framebuffer& image, int rows, bool ppm);
+void write_rows_rle(std::ostream& outfile, const Framebuffer& image, int rows);
+
+// writes the whole image as an uncompressed TGA using threads threads to pack the rows
+// (tasks on pool if it's given, so nothing has to be started) returns false if anything went wrong
+bool write_tga(const std::string& name, const Framebuffer& image, int threads, ThreadPool* pool = nullptr);
+
+// writes the whole image as a run-length encoded TGA, each thread encodes a block of rows
+// bytesWritten (if given) gets the size of the file
+bool write_tga_rle(const std::string& name, const Framebuffer& image, int threads, size_t* bytesWritten = nullptr,
+                   ThreadPool* pool = nullptr);
+
+// writes the image in whichever format was asked for, bytesWritten (if given) gets the size of the file
+bool write_image(const std::string& name, const Framebuffer& image, OutputFormat format, int threads,
+                 size_t* bytesWritten = nullptr, ThreadPool* pool = nullptr);
+
+// the same into a stream, for images that aren't going straight to a file (the TGAs are written on this thread)
+bool encode_image(std::ostream& outfile, const Framebuffer& image, OutputFormat format, int threads);
+
+#endif //MANDELBROT_ENCODE_H
@@ -0,0 +1,153 @@
+// Encoder benchmark
+// Renders the default view once and then times the original writer (a std::ofstream write for every pixel) and each
+// format (TGA, RLE TGA, PNG) at 1, 2, 4... threads, along with how many bytes each one writes and how much faster
+// than the original it is
+//
+// usage: encode_bench [width] [height] [max threads] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "encode.h"
+#include "framebuffer.h"
+#include "kernel.h"
+
+typedef std::chrono::steady_clock theClock;
+
+const char* benchFile = "encode_bench.out";
+
+// same picture main() makes by default, white set on black
+void render(Framebuffer& image) {
+	const int maxIt = 500;
+	const KernelOptions options = { true, 1e-12, 2, Fractal::Mandelbrot, 0.0, 0.0 };
+	const EscapeRowFn kernel = kernel_function(best_kernel(), Precision::Double, options, maxIt);
+	KernelStats stats = {};
+	const double left = -2.0, right = 1.0, top = 1.125, bottom = -1.125;
+	const double dx = (right - left) / image.width();
+	for (int y = 0; y < image.height(); ++y) {
+		uint32_t* row = image.row(y);
+		kernel(left, dx, 0, 1, top + (y * (bottom - top) / image.height()), image.width(), maxIt, options, stats, row);
+		for (int x = 0; x < image.width(); ++x) {
+			row[x] = (row[x] == uint32_t(maxIt)) ? 0xFFFFFF : 0x000000;
+		}
+	}
+}
+
+size_t file_size(const char* name) {
+	FILE* file = fopen(name, "rb");
+	if (file == nullptr) {
+		return 0;
+	}
+	fseek(file, 0, SEEK_END);
+	const long size = ftell(file);
+	fclose(file);
+	return size < 0 ? 0 : size_t(size);
+}
+
+// the TGA writer main.cpp started out with, three bytes at a time through an ofstream
+bool write_ofstream(const char* name, const Framebuffer& image) {
+	std::ofstream outfile(name, std::ofstream::binary);
+	write_tga_header(outfile, image.width(), image.height());
+	for (int y = 0; y < image.height(); ++y) {
+		const uint32_t* row = image.row(y);
+		for (int x = 0; x < image.width(); ++x) {
+			uint8_t pixel[3] = {
+				static_cast<uint8_t>(row[x] & 0xFF), // blue channel
+				static_cast<uint8_t>(row[x] >> 8 & 0xFF), // green channel
+				static_cast<uint8_t>(row[x] >> 16 & 0xFF), // red channel
+			};
+			outfile.write((const char*)pixel, 3);
+		}
+	}
+	outfile.close();
+	return bool(outfile);
+}
+
+// runs write reps times, the fastest time goes in best (microseconds) and the file size in bytes
+bool time_writes(const std::function<bool()>& write, int reps, long long& best, size_t& bytes) {
+	best = -1;
+	for (int rep = 0; rep < reps; ++rep) {
+		theClock::time_point start = theClock::now();
+		const bool ok = write();
+		theClock::time_point end = theClock::now();
+		if (!ok) {
+			std::cout << "Error writing to " << benchFile << std::endl;
+			return false;
+		}
+		const long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+		if (best < 0 || us < best) {
+			best = us;
+		}
+	}
+	bytes = file_size(benchFile);
+	return true;
+}
+
+void print_row(const char* name, int threads, long long best, size_t bytes, double inputMB, long long baseline) {
+	std::cout << std::left << std::setw(12) << name << std::right << std::setw(10) << threads
+	          << std::fixed << std::setprecision(2) << std::setw(12) << best / 1000.0
+	          << std::setw(14) << bytes << std::setw(12) << inputMB / (std::max(best, 1LL) / 1e6)
+	          << std::setw(12) << double(baseline) / std::max(best, 1LL) << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	const int width = argc > 1 ? std::atoi(argv[1]) : 4096;
+	const int height = argc > 2 ? std::atoi(argv[2]) : 3072;
+	const int maxThreads = argc > 3 ? std::atoi(argv[3]) : std::max(1, int(std::thread::hardware_concurrency()));
+	const int reps = argc > 4 ? std::atoi(argv[4]) : 5;
+
+	if (width <= 0 || height <= 0 || !fits_tga(width, height) || maxThreads <= 0 || reps <= 0) {
+		std::cout << "usage: encode_bench [width] [height] [max threads] [repetitions]" << std::endl;
+		return 1;
+	}
+
+	Framebuffer image(width, height);
+	render(image);
+
+	// throughput is measured against the raw 24-bit pixels, the same as the Encode Throughput in index.txt,
+	// so the formats can be compared with each other and with a render's own figure
+	const double inputMB = double(width) * height * 3 / (1024 * 1024);
+
+	std::cout << "Encoding " << width << "*" << height << ", best of " << reps << std::endl;
+	std::cout << std::left << std::setw(12) << "format" << std::right << std::setw(10) << "threads"
+	          << std::setw(12) << "best ms" << std::setw(14) << "bytes" << std::setw(12) << "MB/s in"
+	          << std::setw(12) << "speedup" << std::endl;
+
+	// what everything else is measured against, it only ever had the one thread
+	long long baseline = 0;
+	size_t bytes = 0;
+	if (!time_writes(std::bind(write_ofstream, benchFile, std::cref(image)), reps, baseline, bytes)) {
+		return 1;
+	}
+	print_row("ofstream", 1, baseline, bytes, inputMB, baseline);
+
+	const char* formats[] = { "tga", "rle-tga", "png" };
+	for (const char* name : formats) {
+		OutputFormat format = OutputFormat::TGA;
+		parse_format(name, format);
+		if (!format_supported(format)) {
+			std::cout << name << " isn't supported by this build" << std::endl;
+			continue;
+		}
+		for (int threads = 1; threads <= maxThreads; threads *= 2) {
+			long long best = -1;
+			const auto write = [&] { return write_image(benchFile, image, format, threads); };
+			if (!time_writes(write, reps, best, bytes)) {
+				return 1;
+			}
+			print_row(name, threads, best, bytes, inputMB, baseline);
+		}
+	}
+
+	std::remove(benchFile);
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include "framebuffer.h"
+
+#include <cstdlib>
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+const size_t hugePageSize = 2 * 1024 * 1024; // x86 transparent huge pages are 2MB
+
+// cache line aligned memory for when mmap isn't an option
+static void* aligned_alloc_bytes(size_t bytes) {
+#ifdef _WIN32
+	return _aligned_malloc(bytes, Framebuffer::cacheLine);
+#else
+	void* memory = nullptr;
+	if (posix_memalign(&memory, Framebuffer::cacheLine, bytes) != 0) {
+		return nullptr;
+	}
+	return memory;
+#endif
+}
+
+static void aligned_free_bytes(void* memory) {
+#ifdef _WIN32
+	_aligned_free(memory);
+#else
+	free(memory);
+#endif
+}
+
+Framebuffer::Framebuffer(int width, int height, bool hugePages)
+		: w(width), h(height), rowStride(0), pixels(nullptr), allocated(0), mapped(false), usingHugePages(false) {
+	if (width <= 0 || height <= 0) {
+		throw std::bad_alloc();
+	}
+
+	// pad each row out to whole cache lines so tiles lined up on cache lines never share one, even across rows
+	rowStride = (size_t(width) + linePixels - 1) / linePixels * linePixels;
+	allocated = rowStride * size_t(height) * sizeof(uint32_t);
+
+#ifdef __linux__
+	// anything over a huge page gets mmapped (rounded up to whole huge pages) and the kernel is asked to
+	// back it with huge pages, anonymous mappings come back zeroed and page aligned
+	if (hugePages && allocated >= hugePageSize) {
+		allocated = (allocated + hugePageSize - 1) / hugePageSize * hugePageSize;
+		void* memory = mmap(nullptr, allocated, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+		mapped = true;
+#ifdef MADV_HUGEPAGE
+		usingHugePages = madvise(memory, allocated, MADV_HUGEPAGE) == 0;
+#endif
+		pixels = static_cast<uint32_t*>(memory);
+		return;
+	}
+#endif
+	(void)hugePages;
+
+	pixels = static_cast<uint32_t*>(aligned_alloc_bytes(allocated));
+	if (pixels == nullptr) {
+		throw std::bad_alloc();
+	}
+}
+
+Framebuffer::~Framebuffer() {
+#ifdef __linux__
+	if (mapped) {
+		munmap(pixels, allocated);
+		return;
+	}
+#endif
+	aligned_free_bytes(pixels);
+}
@@ -0,0 +1,48 @@
+// Heap allocated image that the render threads write into
+// Every row starts on a cache line and, on Linux, big images ask for transparent huge pages
+// so a 16k+ render isn't spending its time on TLB misses
+
+#ifndef MANDELBROT_FRAMEBUFFER_H
+#define MANDELBROT_FRAMEBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+class Framebuffer {
+public:
+	static const int cacheLine = 64; // bytes, each row gets padded out to a multiple of this
+	static const int linePixels = cacheLine / int(sizeof(uint32_t));
+
+	// throws std::bad_alloc if the memory can't be had
+	Framebuffer(int width, int height, bool hugePages = true);
+	~Framebuffer();
+
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	int width() const { return w; }
+	int height() const { return h; }
+
+	// pixels from the start of one row to the start of the next (always a whole number of cache lines)
+	size_t stride() const { return rowStride; }
+
+	// pixels are 0xRRGGBB
+	uint32_t* row(int y) { return pixels + size_t(y) * rowStride; }
+	const uint32_t* row(int y) const { return pixels + size_t(y) * rowStride; }
+
+	// true if the kernel agreed to back the buffer with huge pages (only a hint, it can still say no)
+	bool hugePages() const { return usingHugePages; }
+
+	size_t bytes() const { return allocated; }
+
+private:
+	int w;
+	int h;
+	size_t rowStride;
+	uint32_t* pixels;
+	size_t allocated;
+	bool mapped; // came from mmap rather than the aligned allocator
+	bool usingHugePages;
+};
+
+#endif //MANDELBROT_FRAMEBUFFER_H
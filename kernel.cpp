@@ -0,0 +1,746 @@
+#include "kernel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "doubledouble.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MANDELBROT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// gcc and clang need to be told a function is allowed to use AVX, msvc lets any function use the intrinsics
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// the parts of the kernels that don't care which number type they're using
+
+// turns the two halves of a PreciseView corner into the kernel's type (only double-double keeps both)
+template <typename T>
+static T from_parts(double hi, double lo) {
+	return T(hi) + T(lo);
+}
+
+template <>
+DoubleDouble from_parts<DoubleDouble>(double hi, double lo) {
+	return two_sum(hi, lo);
+}
+
+template <typename T>
+static T abs_value(const T& value) {
+	return value < T(0.0) ? -value : value;
+}
+
+// true if c is inside the main cardioid or the period-2 bulb, both of which are entirely inside the set
+template <typename T>
+static bool in_cardioid_or_bulb(const T& cr, const T& ci) {
+	const T ci2 = ci * ci;
+
+	// cardioid: q(q + (x - 1/4)) <= y^2 / 4 where q = (x - 1/4)^2 + y^2
+	const T xq = cr - T(0.25);
+	const T q = xq * xq + ci2;
+	if (q * (q + xq) <= T(0.25) * ci2) {
+		return true;
+	}
+
+	// bulb: the circle of radius 1/4 around -1
+	const T xb = cr + T(1.0);
+	return xb * xb + ci2 <= T(0.0625);
+}
+
+// how many iterations go by before the first saved point for the periodicity check, doubled every time after
+const int firstPeriodCheck = 8;
+
+// the SIMD kernels count iterations in the same type as the maths, floats only hold whole numbers exactly up to 2^24
+const int maxFloatCount = 1 << 24;
+
+// the SIMD kernels stop to check whether every lane has escaped after this many iterations once maxIt is past
+// longRunIterations (up to there checking every iteration lets short rows finish sooner)
+const int blockIterations = 8;
+const int longRunIterations = 256;
+
+// z = z^Power + c, with zr2 and zi2 the squares of z that the escape test has already worked out
+// (Power is a template argument, so only one branch is left once it's compiled)
+template <int Power, typename T>
+static void advance(T& zr, T& zi, const T& zr2, const T& zi2, const T& cr, const T& ci) {
+	if (Power == 3) {
+		const T three(3.0);
+		const T zrTemp = zr * (zr2 - three * zi2) + cr;
+		zi = zi * (three * zr2 - zi2) + ci;
+		zr = zrTemp;
+	} else if (Power == 4) {
+		const T a = zr2 - zi2;
+		const T zrzi = zr * zi;
+		const T b = zrzi + zrzi;
+		const T ab = a * b;
+		zr = a * a - b * b + cr;
+		zi = ab + ab + ci;
+	} else {
+		const T zrzi = zr * zi;
+		zr = zr2 - zi2 + cr;
+		zi = zrzi + zrzi + ci;
+	}
+}
+
+// one pixel, comparing the squared magnitude against 4 so there's no square root per iteration
+// For the Mandelbrot set (pr, pi) is c and z starts at 0, for a Julia set z starts at (pr, pi) and c is fixed.
+template <typename T, int Power, bool Julia>
+static uint32_t escape_point(const T& pr, const T& pi, int maxIt, const KernelOptions& options, KernelStats& stats) {
+	++stats.pixels;
+
+	// the cardioid and bulb are only known shapes for z^2 + c
+	if (Power == 2 && !Julia && options.cullInterior && in_cardioid_or_bulb(pr, pi)) {
+		++stats.culled;
+		stats.savedIterations += uint64_t(maxIt);
+		return uint32_t(maxIt);
+	}
+
+	const T four(4.0);
+	const T tolerance(options.periodTolerance);
+	const bool checkPeriod = options.periodTolerance > 0.0;
+
+	const T cr = Julia ? T(options.juliaRe) : pr;
+	const T ci = Julia ? T(options.juliaIm) : pi;
+	T zr = Julia ? pr : T(0.0);
+	T zi = Julia ? pi : T(0.0);
+	int it = 0;
+
+	// Brent's cycle detection: compare z against a saved point, and move the saved point up
+	// every time the gap between them doubles, so any cycle length gets caught eventually
+	T oldR = zr;
+	T oldI = zi;
+	int checkEvery = firstPeriodCheck;
+	int sinceCheck = 0;
+	bool periodic = false;
+
+	while (it < maxIt) {
+		const T zr2 = zr * zr;
+		const T zi2 = zi * zi;
+		if (!(zr2 + zi2 < four)) {
+			break;
+		}
+		advance<Power>(zr, zi, zr2, zi2, cr, ci);
+		++it;
+
+		if (checkPeriod) {
+			if (abs_value(zr - oldR) < tolerance && abs_value(zi - oldI) < tolerance) {
+				periodic = true; // the orbit's come back round, so it never escapes
+				break;
+			}
+			if (++sinceCheck == checkEvery) {
+				sinceCheck = 0;
+				checkEvery *= 2;
+				oldR = zr;
+				oldI = zi;
+			}
+		}
+	}
+
+	stats.iterations += uint64_t(it);
+	if (periodic) {
+		++stats.periodic;
+		stats.savedIterations += uint64_t(maxIt - it);
+		it = maxIt;
+	}
+	if (it < maxIt) {
+		++stats.escaped;
+	}
+	return uint32_t(it);
+}
+
+// one pixel at a time, the mapping is done in T as well so the tail of a SIMD row matches its lanes exactly
+template <typename T, int Power, bool Julia>
+static void escape_row_scalar(double left, double dx, int x0, int step, double ci, int count, int maxIt,
+                              const KernelOptions& options, KernelStats& stats, uint32_t* out) {
+	const T tLeft(left);
+	const T tDx(dx);
+	const T tCi(ci);
+	for (int i = 0; i < count; ++i) {
+		out[i] = escape_point<T, Power, Julia>(tLeft + T(x0 + i * step) * tDx, tCi, maxIt, options, stats);
+	}
+}
+
+// the long double and double-double kernels, which work out each c from the precise corner
+template <typename T, int Power, bool Julia>
+static void escape_row_precise(const PreciseView& view, int x0, int step, int y, int count, int maxIt,
+                               const KernelOptions& options, KernelStats& stats, uint32_t* out) {
+	const T left = from_parts<T>(view.leftHi, view.leftLo);
+	const T top = from_parts<T>(view.topHi, view.topLo);
+	const T dx(view.dx);
+	const T ci = top + T(double(y)) * T(view.dy);
+	for (int i = 0; i < count; ++i) {
+		out[i] = escape_point<T, Power, Julia>(left + T(double(x0 + i * step)) * dx, ci, maxIt, options, stats);
+	}
+}
+
+#ifdef MANDELBROT_X86
+
+static int count_bits(unsigned bits) {
+	int count = 0;
+	for (; bits != 0; bits &= bits - 1) {
+		++count;
+	}
+	return count;
+}
+
+// AVX2 instructions for each number type, the kernel below is written against these
+// (the masks are whole vectors, all ones in the lanes that are set)
+struct Avx2Double {
+	typedef __m256d Vec;
+	typedef double Scalar;
+	static const int lanes = 4;
+
+	TARGET_AVX2 static Vec set1(double value) { return _mm256_set1_pd(value); }
+	TARGET_AVX2 static Vec zero() { return _mm256_setzero_pd(); }
+	TARGET_AVX2 static Vec all_ones() { return _mm256_castsi256_pd(_mm256_set1_epi64x(-1)); }
+	TARGET_AVX2 static Vec lane_offsets() { return _mm256_set_pd(3.0, 2.0, 1.0, 0.0); }
+	TARGET_AVX2 static Vec add(Vec a, Vec b) { return _mm256_add_pd(a, b); }
+	TARGET_AVX2 static Vec sub(Vec a, Vec b) { return _mm256_sub_pd(a, b); }
+	TARGET_AVX2 static Vec mul(Vec a, Vec b) { return _mm256_mul_pd(a, b); }
+	TARGET_AVX2 static Vec and_(Vec a, Vec b) { return _mm256_and_pd(a, b); }
+	TARGET_AVX2 static Vec andnot(Vec a, Vec b) { return _mm256_andnot_pd(a, b); }
+	TARGET_AVX2 static Vec or_(Vec a, Vec b) { return _mm256_or_pd(a, b); }
+	TARGET_AVX2 static Vec abs(Vec a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+	TARGET_AVX2 static Vec less(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+	TARGET_AVX2 static Vec less_equal(Vec a, Vec b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+	TARGET_AVX2 static Vec blend(Vec a, Vec b, Vec mask) { return _mm256_blendv_pd(a, b, mask); }
+	TARGET_AVX2 static int movemask(Vec a) { return _mm256_movemask_pd(a); }
+	TARGET_AVX2 static void store_counts(uint32_t* out, Vec counts) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_cvtpd_epi32(counts));
+	}
+	TARGET_AVX2 static double sum(Vec a) {
+		double lanes[4];
+		_mm256_storeu_pd(lanes, a);
+		return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+};
+
+struct Avx2Float {
+	typedef __m256 Vec;
+	typedef float Scalar;
+	static const int lanes = 8;
+
+	TARGET_AVX2 static Vec set1(double value) { return _mm256_set1_ps(float(value)); }
+	TARGET_AVX2 static Vec zero() { return _mm256_setzero_ps(); }
+	TARGET_AVX2 static Vec all_ones() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+	TARGET_AVX2 static Vec lane_offsets() { return _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f); }
+	TARGET_AVX2 static Vec add(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+	TARGET_AVX2 static Vec sub(Vec a, Vec b) { return _mm256_sub_ps(a, b); }
+	TARGET_AVX2 static Vec mul(Vec a, Vec b) { return _mm256_mul_ps(a, b); }
+	TARGET_AVX2 static Vec and_(Vec a, Vec b) { return _mm256_and_ps(a, b); }
+	TARGET_AVX2 static Vec andnot(Vec a, Vec b) { return _mm256_andnot_ps(a, b); }
+	TARGET_AVX2 static Vec or_(Vec a, Vec b) { return _mm256_or_ps(a, b); }
+	TARGET_AVX2 static Vec abs(Vec a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	TARGET_AVX2 static Vec less(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	TARGET_AVX2 static Vec less_equal(Vec a, Vec b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	TARGET_AVX2 static Vec blend(Vec a, Vec b, Vec mask) { return _mm256_blendv_ps(a, b, mask); }
+	TARGET_AVX2 static int movemask(Vec a) { return _mm256_movemask_ps(a); }
+	TARGET_AVX2 static void store_counts(uint32_t* out, Vec counts) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_cvtps_epi32(counts));
+	}
+	TARGET_AVX2 static double sum(Vec a) {
+		float lanes[8];
+		_mm256_storeu_ps(lanes, a);
+		double total = 0.0;
+		for (float lane : lanes) {
+			total += lane;
+		}
+		return total;
+	}
+};
+
+// 4 (double) or 8 (float) pixels per iteration, lanes that have escaped are masked out of the iteration count
+// and the group stops once every lane has escaped, checked every Block iterations
+template <typename Ops, int Block, int Power, bool Julia>
+TARGET_AVX2 static void escape_row_avx2(double left, double dx, int x0, int step, double ci, int count, int maxIt,
+                                        const KernelOptions& options, KernelStats& stats, uint32_t* out) {
+	typedef typename Ops::Vec Vec;
+	typedef typename Ops::Scalar Scalar;
+	const int lanes = Ops::lanes;
+	if (sizeof(Scalar) < sizeof(double) && maxIt > maxFloatCount) {
+		escape_row_avx2<Avx2Double, Block, Power, Julia>(left, dx, x0, step, ci, count, maxIt, options, stats, out);
+		return;
+	}
+
+	const Vec four = Ops::set1(4.0);
+	const Vec three = Ops::set1(3.0);
+	const Vec one = Ops::set1(1.0);
+	const Vec juliaRe = Ops::set1(options.juliaRe);
+	const Vec juliaIm = Ops::set1(options.juliaIm);
+	const Vec offsets = Ops::mul(Ops::lane_offsets(), Ops::set1(double(step))); // whole numbers, so still exact
+	const Vec vLeft = Ops::set1(Scalar(left));
+	const Vec vDx = Ops::set1(Scalar(dx));
+	const Vec vCi = Ops::set1(Scalar(ci));
+	const Vec vMaxIt = Ops::set1(double(maxIt));
+	const Vec tolerance = Ops::set1(options.periodTolerance);
+	const bool checkPeriod = options.periodTolerance > 0.0;
+
+	// the cardioid/bulb test only depends on ci for the parts that are the same across the row
+	const Vec quarter = Ops::set1(0.25);
+	const Vec sixteenth = Ops::set1(0.0625);
+	const Scalar ciSquared = Scalar(ci) * Scalar(ci);
+	const Vec ci2 = Ops::set1(ciSquared);
+	const Vec ci2Quarter = Ops::set1(Scalar(0.25) * ciSquared);
+
+	int i = 0;
+	for (; i + lanes <= count; i += lanes) {
+		const Vec xs = Ops::add(Ops::set1(Scalar(x0 + i * step)), offsets);
+		const Vec pr = Ops::add(vLeft, Ops::mul(xs, vDx));
+
+		// Mandelbrot: z starts at 0 and c is the pixel, Julia: the other way round
+		const Vec cRe = Julia ? juliaRe : pr;
+		const Vec cIm = Julia ? juliaIm : vCi;
+		Vec zr = Julia ? pr : Ops::zero();
+		Vec zi = Julia ? vCi : Ops::zero();
+		Vec iters = Ops::zero(); // iterations actually done
+		Vec active = Ops::all_ones();
+		Vec culled = Ops::zero();
+		Vec periodic = Ops::zero();
+
+		if (Power == 2 && !Julia && options.cullInterior) {
+			// lanes inside the cardioid or bulb sit out the loop
+			const Vec xq = Ops::sub(pr, quarter);
+			const Vec q = Ops::add(Ops::mul(xq, xq), ci2);
+			const Vec cardioid = Ops::less_equal(Ops::mul(q, Ops::add(q, xq)), ci2Quarter);
+			const Vec xb = Ops::add(pr, one);
+			const Vec bulb = Ops::less_equal(Ops::add(Ops::mul(xb, xb), ci2), sixteenth);
+			culled = Ops::or_(cardioid, bulb);
+			active = Ops::andnot(culled, active);
+		}
+
+		// every lane starts on the same iteration, so they can share Brent's schedule
+		Vec oldR = zr;
+		Vec oldI = zi;
+		int checkEvery = firstPeriodCheck;
+		int sinceCheck = 0;
+
+		for (int it = 0; it < maxIt;) {
+			// lanes that escape part way through a block carry on iterating (off to infinity, then NaN) but
+			// they're out of active so they stop counting straight away
+			const int steps = std::min(Block, maxIt - it);
+			for (int step = 0; step < steps; ++step) {
+				const Vec zr2 = Ops::mul(zr, zr);
+				const Vec zi2 = Ops::mul(zi, zi);
+				active = Ops::and_(active, Ops::less(Ops::add(zr2, zi2), four));
+				iters = Ops::add(iters, Ops::and_(active, one));
+
+				if (Power == 3) {
+					const Vec zrTemp = Ops::add(Ops::mul(zr, Ops::sub(zr2, Ops::mul(three, zi2))), cRe);
+					zi = Ops::add(Ops::mul(zi, Ops::sub(Ops::mul(three, zr2), zi2)), cIm);
+					zr = zrTemp;
+				} else if (Power == 4) {
+					const Vec a = Ops::sub(zr2, zi2);
+					const Vec zrzi = Ops::mul(zr, zi);
+					const Vec b = Ops::add(zrzi, zrzi);
+					const Vec ab = Ops::mul(a, b);
+					zr = Ops::add(Ops::sub(Ops::mul(a, a), Ops::mul(b, b)), cRe);
+					zi = Ops::add(Ops::add(ab, ab), cIm);
+				} else {
+					const Vec zrzi = Ops::mul(zr, zi);
+					zr = Ops::add(Ops::sub(zr2, zi2), cRe);
+					zi = Ops::add(Ops::add(zrzi, zrzi), cIm);
+				}
+
+				if (checkPeriod) {
+					const Vec nearR = Ops::less(Ops::abs(Ops::sub(zr, oldR)), tolerance);
+					const Vec nearI = Ops::less(Ops::abs(Ops::sub(zi, oldI)), tolerance);
+					const Vec cycled = Ops::and_(active, Ops::and_(nearR, nearI));
+					periodic = Ops::or_(periodic, cycled);
+					active = Ops::andnot(cycled, active);
+					if (++sinceCheck == checkEvery) {
+						sinceCheck = 0;
+						checkEvery *= 2;
+						oldR = zr;
+						oldI = zi;
+					}
+				}
+			}
+			it += steps;
+			if (Ops::movemask(active) == 0) {
+				break; // every lane has escaped (or been caught in a cycle)
+			}
+		}
+
+		// culled and cycling lanes are in the set, so they report maxIt whatever they got up to
+		const Vec interior = Ops::or_(culled, periodic);
+		Ops::store_counts(out + i, Ops::blend(iters, vMaxIt, interior));
+
+		stats.pixels += uint64_t(lanes);
+		stats.escaped += uint64_t(count_bits(unsigned(Ops::movemask(Ops::andnot(interior, Ops::less(iters, vMaxIt))))));
+		stats.iterations += uint64_t(Ops::sum(iters));
+		stats.savedIterations += uint64_t(Ops::sum(Ops::and_(interior, Ops::sub(vMaxIt, iters))));
+		stats.culled += uint64_t(count_bits(unsigned(Ops::movemask(culled))));
+		stats.periodic += uint64_t(count_bits(unsigned(Ops::movemask(periodic))));
+	}
+
+	// whatever doesn't fill a whole group
+	if (i < count) {
+		escape_row_scalar<Scalar, Power, Julia>(left, dx, x0 + i * step, step, ci, count - i, maxIt, options, stats, out + i);
+	}
+}
+
+// same again for AVX-512, which has proper mask registers
+struct Avx512Double {
+	typedef __m512d Vec;
+	typedef __mmask8 Mask;
+	typedef double Scalar;
+	typedef Avx2Double Narrower; // what does the tail
+	static const int lanes = 8;
+
+	TARGET_AVX512 static Mask all_lanes() { return 0xFF; }
+	TARGET_AVX512 static Vec set1(double value) { return _mm512_set1_pd(value); }
+	TARGET_AVX512 static Vec zero() { return _mm512_setzero_pd(); }
+	TARGET_AVX512 static Vec lane_offsets() { return _mm512_set_pd(7.0, 6.0, 5.0, 4.0, 3.0, 2.0, 1.0, 0.0); }
+	TARGET_AVX512 static Vec add(Vec a, Vec b) { return _mm512_add_pd(a, b); }
+	TARGET_AVX512 static Vec sub(Vec a, Vec b) { return _mm512_sub_pd(a, b); }
+	TARGET_AVX512 static Vec mul(Vec a, Vec b) { return _mm512_mul_pd(a, b); }
+	TARGET_AVX512 static Vec abs(Vec a) { return _mm512_abs_pd(a); }
+	TARGET_AVX512 static Mask less(Mask k, Vec a, Vec b) { return _mm512_mask_cmp_pd_mask(k, a, b, _CMP_LT_OQ); }
+	TARGET_AVX512 static Mask less_equal(Vec a, Vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LE_OQ); }
+	TARGET_AVX512 static Vec mask_add(Vec src, Mask k, Vec a, Vec b) { return _mm512_mask_add_pd(src, k, a, b); }
+	TARGET_AVX512 static Vec mask_mov(Vec src, Mask k, Vec a) { return _mm512_mask_mov_pd(src, k, a); }
+	TARGET_AVX512 static Vec maskz_sub(Mask k, Vec a, Vec b) { return _mm512_maskz_sub_pd(k, a, b); }
+	TARGET_AVX512 static double sum(Vec a) { return _mm512_reduce_add_pd(a); }
+	TARGET_AVX512 static void store_counts(uint32_t* out, Vec counts) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm512_cvtpd_epi32(counts));
+	}
+};
+
+struct Avx512Float {
+	typedef __m512 Vec;
+	typedef __mmask16 Mask;
+	typedef float Scalar;
+	typedef Avx2Float Narrower;
+	static const int lanes = 16;
+
+	TARGET_AVX512 static Mask all_lanes() { return 0xFFFF; }
+	TARGET_AVX512 static Vec set1(double value) { return _mm512_set1_ps(float(value)); }
+	TARGET_AVX512 static Vec zero() { return _mm512_setzero_ps(); }
+	TARGET_AVX512 static Vec lane_offsets() {
+		return _mm512_set_ps(15.0f, 14.0f, 13.0f, 12.0f, 11.0f, 10.0f, 9.0f, 8.0f, 7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+	}
+	TARGET_AVX512 static Vec add(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+	TARGET_AVX512 static Vec sub(Vec a, Vec b) { return _mm512_sub_ps(a, b); }
+	TARGET_AVX512 static Vec mul(Vec a, Vec b) { return _mm512_mul_ps(a, b); }
+	TARGET_AVX512 static Vec abs(Vec a) { return _mm512_abs_ps(a); }
+	TARGET_AVX512 static Mask less(Mask k, Vec a, Vec b) { return _mm512_mask_cmp_ps_mask(k, a, b, _CMP_LT_OQ); }
+	TARGET_AVX512 static Mask less_equal(Vec a, Vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	TARGET_AVX512 static Vec mask_add(Vec src, Mask k, Vec a, Vec b) { return _mm512_mask_add_ps(src, k, a, b); }
+	TARGET_AVX512 static Vec mask_mov(Vec src, Mask k, Vec a) { return _mm512_mask_mov_ps(src, k, a); }
+	TARGET_AVX512 static Vec maskz_sub(Mask k, Vec a, Vec b) { return _mm512_maskz_sub_ps(k, a, b); }
+	TARGET_AVX512 static double sum(Vec a) {
+		// in doubles, a float would lose count past 2^24
+		const __m256 low = _mm512_castps512_ps256(a);
+		const __m256 high = _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1));
+		return _mm512_reduce_add_pd(_mm512_cvtps_pd(low)) + _mm512_reduce_add_pd(_mm512_cvtps_pd(high));
+	}
+	TARGET_AVX512 static void store_counts(uint32_t* out, Vec counts) {
+		_mm512_storeu_si512(out, _mm512_cvtps_epi32(counts));
+	}
+};
+
+template <typename Ops, int Block, int Power, bool Julia>
+TARGET_AVX512 static void escape_row_avx512(double left, double dx, int x0, int step, double ci, int count, int maxIt,
+                                          const KernelOptions& options, KernelStats& stats, uint32_t* out) {
+	typedef typename Ops::Vec Vec;
+	typedef typename Ops::Mask Mask;
+	typedef typename Ops::Scalar Scalar;
+	const int lanes = Ops::lanes;
+	if (sizeof(Scalar) < sizeof(double) && maxIt > maxFloatCount) {
+		escape_row_avx512<Avx512Double, Block, Power, Julia>(left, dx, x0, step, ci, count, maxIt, options, stats, out);
+		return;
+	}
+
+	const Vec four = Ops::set1(4.0);
+	const Vec three = Ops::set1(3.0);
+	const Vec one = Ops::set1(1.0);
+	const Vec juliaRe = Ops::set1(options.juliaRe);
+	const Vec juliaIm = Ops::set1(options.juliaIm);
+	const Vec offsets = Ops::mul(Ops::lane_offsets(), Ops::set1(double(step))); // whole numbers, so still exact
+	const Vec vLeft = Ops::set1(Scalar(left));
+	const Vec vDx = Ops::set1(Scalar(dx));
+	const Vec vCi = Ops::set1(Scalar(ci));
+	const Vec vMaxIt = Ops::set1(double(maxIt));
+	const Vec tolerance = Ops::set1(options.periodTolerance);
+	const bool checkPeriod = options.periodTolerance > 0.0;
+
+	const Vec quarter = Ops::set1(0.25);
+	const Vec sixteenth = Ops::set1(0.0625);
+	const Scalar ciSquared = Scalar(ci) * Scalar(ci);
+	const Vec ci2 = Ops::set1(ciSquared);
+	const Vec ci2Quarter = Ops::set1(Scalar(0.25) * ciSquared);
+
+	int i = 0;
+	for (; i + lanes <= count; i += lanes) {
+		const Vec xs = Ops::add(Ops::set1(Scalar(x0 + i * step)), offsets);
+		const Vec pr = Ops::add(vLeft, Ops::mul(xs, vDx));
+
+		const Vec cRe = Julia ? juliaRe : pr;
+		const Vec cIm = Julia ? juliaIm : vCi;
+		Vec zr = Julia ? pr : Ops::zero();
+		Vec zi = Julia ? vCi : Ops::zero();
+		Vec iters = Ops::zero();
+		Mask active = Ops::all_lanes();
+		Mask culled = 0;
+		Mask periodic = 0;
+
+		if (Power == 2 && !Julia && options.cullInterior) {
+			const Vec xq = Ops::sub(pr, quarter);
+			const Vec q = Ops::add(Ops::mul(xq, xq), ci2);
+			const Mask cardioid = Ops::less_equal(Ops::mul(q, Ops::add(q, xq)), ci2Quarter);
+			const Vec xb = Ops::add(pr, one);
+			const Mask bulb = Ops::less_equal(Ops::add(Ops::mul(xb, xb), ci2), sixteenth);
+			culled = Mask(cardioid | bulb);
+			active = Mask(active & ~culled);
+		}
+
+		Vec oldR = zr;
+		Vec oldI = zi;
+		int checkEvery = firstPeriodCheck;
+		int sinceCheck = 0;
+
+		for (int it = 0; it < maxIt;) {
+			const int steps = std::min(Block, maxIt - it);
+			for (int step = 0; step < steps; ++step) {
+				const Vec zr2 = Ops::mul(zr, zr);
+				const Vec zi2 = Ops::mul(zi, zi);
+				active = Ops::less(active, Ops::add(zr2, zi2), four);
+				iters = Ops::mask_add(iters, active, iters, one);
+
+				if (Power == 3) {
+					const Vec zrTemp = Ops::add(Ops::mul(zr, Ops::sub(zr2, Ops::mul(three, zi2))), cRe);
+					zi = Ops::add(Ops::mul(zi, Ops::sub(Ops::mul(three, zr2), zi2)), cIm);
+					zr = zrTemp;
+				} else if (Power == 4) {
+					const Vec a = Ops::sub(zr2, zi2);
+					const Vec zrzi = Ops::mul(zr, zi);
+					const Vec b = Ops::add(zrzi, zrzi);
+					const Vec ab = Ops::mul(a, b);
+					zr = Ops::add(Ops::sub(Ops::mul(a, a), Ops::mul(b, b)), cRe);
+					zi = Ops::add(Ops::add(ab, ab), cIm);
+				} else {
+					const Vec zrzi = Ops::mul(zr, zi);
+					zr = Ops::add(Ops::sub(zr2, zi2), cRe);
+					zi = Ops::add(Ops::add(zrzi, zrzi), cIm);
+				}
+
+				if (checkPeriod) {
+					const Mask nearR = Ops::less(active, Ops::abs(Ops::sub(zr, oldR)), tolerance);
+					const Mask cycled = Ops::less(nearR, Ops::abs(Ops::sub(zi, oldI)), tolerance);
+					periodic = Mask(periodic | cycled);
+					active = Mask(active & ~cycled);
+					if (++sinceCheck == checkEvery) {
+						sinceCheck = 0;
+						checkEvery *= 2;
+						oldR = zr;
+						oldI = zi;
+					}
+				}
+			}
+			it += steps;
+			if (active == 0) {
+				break;
+			}
+		}
+
+		const Mask interior = Mask(culled | periodic);
+		Ops::store_counts(out + i, Ops::mask_mov(iters, interior, vMaxIt));
+
+		stats.pixels += uint64_t(lanes);
+		stats.escaped += uint64_t(count_bits(Ops::less(Mask(~interior), iters, vMaxIt)));
+		stats.iterations += uint64_t(Ops::sum(iters));
+		stats.savedIterations += uint64_t(Ops::sum(Ops::maskz_sub(interior, vMaxIt, iters)));
+		stats.culled += uint64_t(count_bits(culled));
+		stats.periodic += uint64_t(count_bits(periodic));
+	}
+
+	if (i < count) {
+		escape_row_avx2<typename Ops::Narrower, Block, Power, Julia>(left, dx, x0 + i * step, step, ci, count - i, maxIt, options,
+		                                                           stats, out + i);
+	}
+}
+
+// checks the CPU has the instructions and the OS saves the wider registers on a context switch
+static bool cpu_has(KernelType type) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!osxsave) {
+		return false;
+	}
+	const unsigned long long xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if (type == KernelType::AVX2) {
+		return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+	}
+	if (type == KernelType::AVX512) {
+		return (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+	}
+	return false;
+#else
+	__builtin_cpu_init();
+	if (type == KernelType::AVX2) {
+		return __builtin_cpu_supports("avx2");
+	}
+	if (type == KernelType::AVX512) {
+		return __builtin_cpu_supports("avx512f");
+	}
+	return false;
+#endif
+}
+
+#endif // MANDELBROT_X86
+
+bool kernel_supported(KernelType type) {
+	if (type == KernelType::Scalar) {
+		return true;
+	}
+#ifdef MANDELBROT_X86
+	return cpu_has(type);
+#else
+	return false;
+#endif
+}
+
+KernelType best_kernel() {
+	if (kernel_supported(KernelType::AVX512)) {
+		return KernelType::AVX512;
+	}
+	if (kernel_supported(KernelType::AVX2)) {
+		return KernelType::AVX2;
+	}
+	return KernelType::Scalar;
+}
+
+// every compiled variant of one kernel, indexed [power - minPower][julia]
+#define FRACTAL_VARIANTS(kernel, ...) { \
+	{ kernel<__VA_ARGS__, 2, false>, kernel<__VA_ARGS__, 2, true> }, \
+	{ kernel<__VA_ARGS__, 3, false>, kernel<__VA_ARGS__, 3, true> }, \
+	{ kernel<__VA_ARGS__, 4, false>, kernel<__VA_ARGS__, 4, true> } }
+
+const int powerCount = maxPower - minPower + 1;
+
+// the dispatch tables, indexed [float/double][short/long run][power][julia] for the SIMD ones
+static const EscapeRowFn scalarKernels[2][powerCount][2] = {
+	FRACTAL_VARIANTS(escape_row_scalar, float),
+	FRACTAL_VARIANTS(escape_row_scalar, double),
+};
+
+#ifdef MANDELBROT_X86
+static const EscapeRowFn avx2Kernels[2][2][powerCount][2] = {
+	{ FRACTAL_VARIANTS(escape_row_avx2, Avx2Float, 1), FRACTAL_VARIANTS(escape_row_avx2, Avx2Float, blockIterations) },
+	{ FRACTAL_VARIANTS(escape_row_avx2, Avx2Double, 1), FRACTAL_VARIANTS(escape_row_avx2, Avx2Double, blockIterations) },
+};
+
+static const EscapeRowFn avx512Kernels[2][2][powerCount][2] = {
+	{ FRACTAL_VARIANTS(escape_row_avx512, Avx512Float, 1), FRACTAL_VARIANTS(escape_row_avx512, Avx512Float, blockIterations) },
+	{ FRACTAL_VARIANTS(escape_row_avx512, Avx512Double, 1), FRACTAL_VARIANTS(escape_row_avx512, Avx512Double, blockIterations) },
+};
+#endif
+
+// [long double/double-double][power][julia]
+static const PreciseRowFn preciseKernels[2][powerCount][2] = {
+	FRACTAL_VARIANTS(escape_row_precise, long double),
+	FRACTAL_VARIANTS(escape_row_precise, DoubleDouble),
+};
+
+static int power_index(const KernelOptions& options) {
+	return std::min(std::max(options.power, minPower), maxPower) - minPower;
+}
+
+EscapeRowFn kernel_function(KernelType type, Precision precision, const KernelOptions& options, int maxIt) {
+	const int wide = precision == Precision::Float ? 0 : 1;
+	const int longRun = maxIt > longRunIterations ? 1 : 0;
+	const int power = power_index(options);
+	const int julia = options.fractal == Fractal::Julia ? 1 : 0;
+#ifdef MANDELBROT_X86
+	switch (type) {
+		case KernelType::AVX512: return avx512Kernels[wide][longRun][power][julia];
+		case KernelType::AVX2: return avx2Kernels[wide][longRun][power][julia];
+		default: break;
+	}
+#endif
+	(void)type;
+	(void)longRun;
+	return scalarKernels[wide][power][julia];
+}
+
+PreciseRowFn precise_function(Precision precision, const KernelOptions& options) {
+	const int doubleDouble = precision == Precision::DoubleDouble ? 1 : 0;
+	return preciseKernels[doubleDouble][power_index(options)][options.fractal == Fractal::Julia ? 1 : 0];
+}
+
+const char* kernel_name(KernelType type) {
+	switch (type) {
+		case KernelType::AVX512: return "AVX-512";
+		case KernelType::AVX2: return "AVX2";
+		default: return "Scalar";
+	}
+}
+
+bool parse_precision(const std::string& text, Precision& precision) {
+	if (text == "float") {
+		precision = Precision::Float;
+	} else if (text == "double") {
+		precision = Precision::Double;
+	} else if (text == "long-double") {
+		precision = Precision::LongDouble;
+	} else if (text == "double-double") {
+		precision = Precision::DoubleDouble;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char* precision_name(Precision precision) {
+	switch (precision) {
+		case Precision::Float: return "float";
+		case Precision::Double: return "double";
+		case Precision::LongDouble: return "long double";
+		default: return "double-double";
+	}
+}
+
+int precision_bits(Precision precision) {
+	switch (precision) {
+		case Precision::Float: return std::numeric_limits<float>::digits;
+		case Precision::Double: return std::numeric_limits<double>::digits;
+		case Precision::LongDouble: return std::numeric_limits<long double>::digits;
+		default: return 2 * std::numeric_limits<double>::digits + 1;
+	}
+}
+
+// bits on top of the ones that tell neighbouring pixels apart, to soak up the rounding the iterations add
+const int precisionGuardBits = 16;
+
+bool choose_precision(double scale, double spacing, Precision& precision) {
+	const double needed = std::log2(std::max(scale, 1.0) / spacing) + precisionGuardBits;
+	const Precision cheapestFirst[] = { Precision::Float, Precision::Double, Precision::LongDouble, Precision::DoubleDouble };
+	for (Precision candidate : cheapestFirst) {
+		if (precision_bits(candidate) >= needed) {
+			precision = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool precision_has_row_kernel(Precision precision) {
+	return precision == Precision::Float || precision == Precision::Double;
+}
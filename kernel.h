@@ -0,0 +1,126 @@
+// Escape-time kernels for the Mandelbrot set
+// Each kernel works out the iteration counts for a run of pixels along one row, the SIMD ones
+// do 4 (AVX2) or 8 (AVX-512) pixels at once and the best one the CPU supports is picked at runtime.
+// The kernels are templated on the number type: float (twice the lanes, for quick previews) and double go
+// through the SIMD kernels, long double and double-double (for zooms past what a double can do) are scalar only.
+// Each one is also compiled separately for every Multibrot power and for Julia sets, so nothing about which
+// fractal is being drawn gets decided inside the loop.
+
+#ifndef MANDELBROT_KERNEL_H
+#define MANDELBROT_KERNEL_H
+
+#include <cstdint>
+#include <string>
+
+// the Multibrot powers there are kernels for, z^power + c
+const int minPower = 2;
+const int maxPower = 4;
+
+// goes into the tile cache's keys, bump it whenever a change here would give different iteration counts
+// so counts cached by the old kernels stop being used
+const int kernelVersion = 1;
+
+enum class Fractal {
+	Mandelbrot, // c is the pixel, z starts at 0
+	Julia, // z starts at the pixel, c is the same everywhere
+};
+
+// switches for the shortcuts the kernels can take, so they can be benchmarked with and without,
+// and which fractal they draw (kernel_function() picks the kernel compiled for it, so the loop doesn't check)
+struct KernelOptions {
+	bool cullInterior; // points inside the main cardioid or the period-2 bulb are in the set, don't iterate them
+	double periodTolerance; // stop once an orbit comes back within this distance of itself (0 turns it off)
+	int power; // minPower to maxPower
+	Fractal fractal;
+	double juliaRe; // c for the Julia set
+	double juliaIm;
+};
+
+// running totals a kernel adds to, each thread keeps its own and they get added up at the end
+struct KernelStats {
+	uint64_t pixels; // pixels worked out
+	uint64_t escaped; // the ones that escaped before maxIt, the rest are in the set
+	uint64_t iterations; // iterations actually done
+	uint64_t culled; // pixels skipped by the cardioid/bulb test
+	uint64_t periodic; // pixels whose orbit was caught repeating before maxIt
+	uint64_t savedIterations; // iterations the two shortcuts above didn't have to do (counting up to maxIt)
+	uint64_t rebases; // deep zoom only, times a pixel's orbit had to be moved back onto the start of the reference
+
+	KernelStats& operator+=(const KernelStats& other) {
+		pixels += other.pixels;
+		escaped += other.escaped;
+		iterations += other.iterations;
+		culled += other.culled;
+		periodic += other.periodic;
+		savedIterations += other.savedIterations;
+		rebases += other.rebases;
+		return *this;
+	}
+};
+
+// pixel x maps to the real value left + x * dx, the whole row shares the imaginary value ci
+// out[i] gets the number of iterations pixel x0 + i * step took to escape (maxIt if it never did),
+// step is 1 apart from the coarse passes of a progressive render
+typedef void (*EscapeRowFn)(double left, double dx, int x0, int step, double ci, int count, int maxIt,
+                            const KernelOptions& options, KernelStats& stats, uint32_t* out);
+
+// pixel x of row y maps to left + x * dx, top + y * dy, with the corner split into two doubles (hi + lo)
+// so it keeps enough digits for the number types bigger than a double
+struct PreciseView {
+	double leftHi;
+	double leftLo;
+	double topHi;
+	double topLo;
+	double dx;
+	double dy;
+};
+
+// the scalar-only kernels for long double and double-double take the whole view instead of left/dx/ci,
+// y is the row of the whole image
+typedef void (*PreciseRowFn)(const PreciseView& view, int x0, int step, int y, int count, int maxIt,
+                             const KernelOptions& options, KernelStats& stats, uint32_t* out);
+
+// the number types the kernels come in, cheapest first
+enum class Precision {
+	Float,
+	Double,
+	LongDouble, // only more than a double where the compiler makes it one (80-bit on x86 with GCC/Clang)
+	DoubleDouble,
+};
+
+// "float", "double", "long-double" or "double-double", returns false for anything else
+bool parse_precision(const std::string& text, Precision& precision);
+const char* precision_name(Precision precision);
+
+// bits of mantissa the type has
+int precision_bits(Precision precision);
+
+// the cheapest precision that can still tell pixels spacing apart around values as big as scale
+// returns false if even double-double can't (perturbation is needed)
+bool choose_precision(double scale, double spacing, Precision& precision);
+
+// false for the types that don't have an EscapeRowFn (long double and double-double need precise_function())
+bool precision_has_row_kernel(Precision precision);
+
+enum class KernelType {
+	Scalar,
+	AVX2,
+	AVX512,
+};
+
+// true if this build and this CPU can run the kernel
+bool kernel_supported(KernelType type);
+
+// the widest kernel the CPU supports, falls back to scalar
+KernelType best_kernel();
+
+// Float or Double, the kernel is the one compiled for options' power and fractal, and for maxIt's range
+// (past a few hundred iterations the SIMD ones only check whether the whole group has escaped every few iterations)
+EscapeRowFn kernel_function(KernelType type, Precision precision, const KernelOptions& options, int maxIt);
+
+// LongDouble or DoubleDouble
+PreciseRowFn precise_function(Precision precision, const KernelOptions& options);
+
+const char* kernel_name(KernelType type);
+
+#endif //MANDELBROT_KERNEL_H
@@ -1,45 +1,281 @@
 // Credit for Mandelbrot set generation algorithm and file write algorithm to Adam Sampson
 // (with a few tweaks by me)
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <fstream>
 #include <complex>
+#include <functional>
 #include <thread>
-#include <mutex>
 #include <atomic>
-#include <condition_variable>
 #include <chrono>
 #include <ctime>
 #include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "bigfixed.h"
+#include "encode.h"
+#include "framebuffer.h"
+#include "kernel.h"
+#include "perfcounters.h"
+#include "perturb.h"
+#include "scheduler.h"
+#include "tilecache.h"
+#include "threadpool.h"
+#include "tileserver.h"
+#include "trace.h"
 
 typedef std::chrono::steady_clock theClock; // alias for clock type that's going to be used
 
-// size of image
-const int width = 1280;
-const int height = 960;
+// default size of image, can be changed with --width and --height
+const int defaultWidth = 1280;
+const int defaultHeight = 960;
+
+const int tileSize = 64; // size of the square tiles handed out to the threads
+const int minSubdivide = 16; // in --subdivide mode rectangles smaller than this either way just get computed
+const int columnWidth = 8; // --subdivide computes columns this wide, a single pixel would waste all but one SIMD lane
+const int defaultMaxIt = 500; // the amount of times we iterate before we determine a point isn't in the set
+const double defaultPeriodTolerance = 1e-12; // how close an orbit has to come back to itself to count as a cycle
+const double periodToleranceSpacing = 1e-6; // the cycle check's tolerance is kept to this fraction of the pixel spacing
+const double minSpacing = 1e-290; // the offsets from the reference are doubles, so much deeper than this they underflow
+const int defaultBandMB = 256; // memory the banded mode is allowed for its bands, change with --band-mb
+const int progressiveSteps[] = { 4, 2, 1 }; // --progressive does every 4th pixel each way, then every 2nd, then the rest
+const int serveConnections = 32; // connections --serve reads requests from at once
+const int defaultServeQueue = 64; // tiles --serve lets wait for a render thread before it says it's busy, change with --serve-queue
+const int maxMapZoom = 30; // the tile numbers have to fit in an int
+const int defaultCacheMB = 512; // how big --cache lets its directory get before it starts dropping tiles, change with --cache-mb
+const int defaultSweepReps = 5; // --sweep takes the median of this many renders at each thread count, change with --sweep-reps
+
+// which order compute() visits the pixels of a tile in
+enum class Traversal {
+	Columns, // x outer, y inner like the original version, every store jumps a whole row ahead
+	Rows, // along each row, so stores go to consecutive addresses
+};
+
+// the region of the complex plane being drawn and the size of the whole image it's mapped onto
+struct View {
+	double left;
+	double right;
+	double top;
+	double bottom;
+	int width;
+	int height;
+};
+
+// everything compute() needs to know apart from where to put the pixels
+struct RenderSettings {
+	View view;
+	EscapeRowFn kernel;
+	PreciseRowFn preciseKernel; // long double or double-double, used instead of kernel when it isn't nullptr
+	PreciseView precise; // the view again for preciseKernel, with the corner to more than a double's precision
+	KernelOptions options;
+	Traversal traversal;
+	int maxIt;
+	int colour;
+	bool subdivide; // Mariani-Silver, fill in rectangles whose whole border took the same number of iterations
+	const ReferenceOrbit* reference; // deep zoom, pixels are iterated as offsets from this (nullptr for plain doubles)
+	TileCache* cache; // --cache, compute() looks each tile up in here before working it out (nullptr for none)
+	std::string cacheKey; // everything the iteration counts depend on apart from which tile it is
+};
+
+// What one render thread did. The thread keeps its own on the stack while it works and only copies it out once it's
+// run out of tiles, so nothing in here is shared (or even touched by anyone else) during the render.
+struct WorkerStats {
+	theClock::duration busy; // working on tiles
+	theClock::duration idle; // waiting for the scheduler to hand over a tile, stealing included
+	uint64_t tiles; // tiles taken off the scheduler, halves of a --subdivide tile included
+	KernelStats kernel;
+
+	WorkerStats& operator+=(const WorkerStats& other) {
+		busy += other.busy;
+		idle += other.idle;
+		tiles += other.tiles;
+		kernel += other.kernel;
+		return *this;
+	}
+};
+
+// the longest any thread was busy over the average, 1 when the work was shared out perfectly (0 without any threads)
+double load_imbalance(const std::vector<WorkerStats>& workers, double& maxBusyMs, double& meanBusyMs) {
+	maxBusyMs = 0.0;
+	meanBusyMs = 0.0;
+	for (const WorkerStats& worker : workers) {
+		const double busyMs = std::chrono::duration<double, std::milli>(worker.busy).count();
+		maxBusyMs = std::max(maxBusyMs, busyMs);
+		meanBusyMs += busyMs / workers.size();
+	}
+	return meanBusyMs > 0 ? maxBusyMs / meanBusyMs : 0.0;
+}
+
+// what gets written to output/index.txt about each render
+struct RunRecord {
+	std::string name;
+	int width;
+	int height;
+	int frames; // 1 apart from --animate
+	int threads;
+	int time;
+	int computeTime;
+	int encodeTime;
+	int firstPreview; // ms until the first --progressive preview was written, -1 if there wasn't one
+	std::string colour;
+	std::string format;
+	size_t encodedBytes;
+	int maxIt;
+	std::string fractal;
+	KernelStats stats; // totals from every thread's kernel calls
+	uint64_t reusedPixels; // --animate only, pixels copied from the frame before instead of computed
+	std::string reuseProblem; // --animate only, why the frames couldn't share pixels (empty if they could)
+	CacheStats cache; // all zeros without --cache
+	std::vector<WorkerStats> workers; // one per render thread, empty for the modes that don't use render_worker()
+};
 
-uint32_t image[height][width]; // image data represented as 0xRRGGBB
+const char* const perfPhaseNames[] = { "Compute", "Encode" };
 
-std::mutex countLock; // mutex for locking the thread count
-std::atomic<int> runThreadsCount(0); // atomic int that keeps count of the number of threads that have been used
-std::condition_variable cv; // condition variable that tells a mutex when a thread has run
+// one phase's hardware counter totals, n/a for the ones this CPU (or kernel) won't count
+std::string perf_line(PerfPhase phase) {
+	const PerfCounts counts = perf_totals(phase);
+	std::ostringstream line;
+	for (int i = 0; i < perfCounterCount; ++i) {
+		line << (i > 0 ? ", " : "") << perf_counter_name(PerfCounter(i)) << " ";
+		if (perf_available(PerfCounter(i))) {
+			line << counts.value[i];
+		} else {
+			line << "n/a";
+		}
+	}
+	const uint64_t cycles = counts[PerfCounter::Cycles];
+	if (cycles > 0 && perf_available(PerfCounter::Instructions)) {
+		line << ", IPC " << double(counts[PerfCounter::Instructions]) / cycles;
+	}
+	return line.str();
+}
 
-void write_txt(const std::string& name, int threads, int time, const std::string& colour) {
+void write_txt(const RunRecord& run) {
+	TraceScope scope("write_txt");
 	std::ofstream outfile;
 
+	// encode throughput is measured against the raw pixels going in, so the formats can be compared
+	const double rawMB = double(run.width) * run.height * run.frames * 3 / (1024 * 1024);
+
+	// iterations saved by the cardioid/bulb test and the cycle check, out of what they'd have cost without them
+	const double attempted = double(run.stats.iterations + run.stats.savedIterations);
+	const double savedPercent = attempted > 0 ? 100.0 * run.stats.savedIterations / attempted : 0.0;
+
+	const uint64_t lookups = run.cache.hits + run.cache.misses;
+
     // change / to '\\' on windows
 	outfile.open("output/index.txt", std::ios_base::app); // append instead of overwrite
-	outfile << name <<
-            ": \n Resolution: " << width << "*" << height <<
-            "\n Colour: " << colour <<
-            "\n Number of threads: " << threads <<
-            "\n Time Taken: " << time << "ms \n\n";
+	outfile << run.name <<
+            ": \n Resolution: " << run.width << "*" << run.height <<
+            "\n Frames: " << run.frames <<
+            "\n Colour: " << run.colour <<
+            "\n Number of threads: " << run.threads <<
+            "\n Time Taken: " << run.time << "ms" <<
+            "\n Compute Time: " << run.computeTime << "ms" <<
+            "\n Encode Time: " << run.encodeTime << "ms" <<
+            "\n First Preview: " << (run.firstPreview >= 0 ? std::to_string(run.firstPreview) + "ms" : "none") <<
+            "\n Format: " << run.format <<
+            "\n Encoded Size: " << run.encodedBytes << " bytes" <<
+            "\n Encode Throughput: " << (run.encodeTime > 0 ? rawMB * 1000 / run.encodeTime : 0.0) << " MB/s" <<
+            "\n Max Iterations: " << run.maxIt <<
+            "\n Fractal: " << run.fractal <<
+            "\n Pixels Computed: " << run.stats.pixels << " of " << uint64_t(run.width) * run.height * run.frames <<
+            "\n Pixels Reused: " << run.reusedPixels << (run.reuseProblem.empty() ? "" : " (" + run.reuseProblem + ")") <<
+            "\n Escaped Pixels: " << run.stats.escaped <<
+            "\n Interior Pixels: " << run.stats.pixels - run.stats.escaped <<
+            "\n Iterations: " << run.stats.iterations <<
+            "\n Culled Points: " << run.stats.culled <<
+            "\n Periodic Points: " << run.stats.periodic <<
+            "\n Iterations Saved: " << run.stats.savedIterations << " (" << savedPercent << "%)" <<
+            "\n Rebases: " << run.stats.rebases <<
+            "\n Cache Hits: " << run.cache.hits << " of " << lookups << " tiles (" << (lookups > 0 ? 100.0 * run.cache.hits / lookups : 0.0) << "%)" <<
+            "\n Cache Bytes Saved: " << run.cache.bytesRead << " bytes";
+
+	// the counters are reset at the start of each job, so the totals are this run's
+	if (perf_enabled()) {
+		for (int phase = 0; phase < perfPhaseCount; ++phase) {
+			outfile << "\n " << perfPhaseNames[phase] << " Counters: " << perf_line(PerfPhase(phase));
+		}
+	}
+
+	if (!run.workers.empty()) {
+		double maxBusy = 0.0;
+		double meanBusy = 0.0;
+		const double imbalance = load_imbalance(run.workers, maxBusy, meanBusy);
+		outfile << "\n Load Imbalance: " << imbalance << " (max busy " << maxBusy << "ms, mean busy " << meanBusy << "ms)";
+		for (size_t i = 0; i < run.workers.size(); ++i) {
+			const WorkerStats& worker = run.workers[i];
+			outfile << "\n Thread " << i << ": busy " << std::chrono::duration<double, std::milli>(worker.busy).count()
+			        << "ms, idle " << std::chrono::duration<double, std::milli>(worker.idle).count() << "ms, "
+			        << worker.tiles << " tiles, " << worker.kernel.iterations << " iterations, " << worker.kernel.escaped
+			        << " escaped, " << worker.kernel.pixels - worker.kernel.escaped << " interior";
+		}
+	}
+	outfile << " \n\n";
 
 	outfile.close();
 }
 
+// the kernel totals for the console
+void print_stats(const KernelStats& stats, uint64_t totalPixels) {
+	const double attempted = double(stats.iterations + stats.savedIterations);
+	std::cout << "Pixels computed: " << stats.pixels << " of " << totalPixels << " (" << stats.escaped << " escaped, "
+	          << stats.pixels - stats.escaped << " interior)" << std::endl;
+	std::cout << "Iterations: " << stats.iterations << ", culled points: " << stats.culled
+	          << ", periodic points: " << stats.periodic << ", iterations saved: " << stats.savedIterations
+	          << " (" << (attempted > 0 ? 100.0 * stats.savedIterations / attempted : 0.0) << "%)" << std::endl;
+	if (stats.rebases > 0) {
+		std::cout << "Rebased onto the reference orbit " << stats.rebases << " times" << std::endl;
+	}
+}
+
+// each render thread's share of the work, and how unevenly it was shared out
+void print_workers(const std::vector<WorkerStats>& workers) {
+	std::cout << std::setw(8) << "thread" << std::setw(12) << "busy ms" << std::setw(12) << "idle ms" << std::setw(8) << "tiles"
+	          << std::setw(14) << "iterations" << std::setw(12) << "escaped" << std::setw(12) << "interior" << std::endl;
+	for (size_t i = 0; i < workers.size(); ++i) {
+		const WorkerStats& worker = workers[i];
+		std::cout << std::fixed << std::setprecision(2) << std::setw(8) << i
+		          << std::setw(12) << std::chrono::duration<double, std::milli>(worker.busy).count()
+		          << std::setw(12) << std::chrono::duration<double, std::milli>(worker.idle).count()
+		          << std::setw(8) << worker.tiles << std::setw(14) << worker.kernel.iterations
+		          << std::setw(12) << worker.kernel.escaped << std::setw(12) << worker.kernel.pixels - worker.kernel.escaped << std::endl;
+	}
+	double maxBusy = 0.0;
+	double meanBusy = 0.0;
+	const double imbalance = load_imbalance(workers, maxBusy, meanBusy);
+	std::cout << "Load imbalance: " << imbalance << " (max busy " << maxBusy << "ms, mean busy " << meanBusy << "ms)" << std::endl;
+	std::cout.unsetf(std::ios_base::floatfield);
+	std::cout << std::setprecision(6);
+}
+
+// what the hardware counters saw in each phase of the last render, nothing if --perf isn't on
+void print_perf() {
+	if (!perf_enabled()) {
+		return;
+	}
+	for (int phase = 0; phase < perfPhaseCount; ++phase) {
+		std::cout << perfPhaseNames[phase] << " counters: " << perf_line(PerfPhase(phase)) << std::endl;
+	}
+}
+
+// what the tile cache saved this run
+void print_cache(const TileCache& cache) {
+	const CacheStats stats = cache.stats();
+	const uint64_t lookups = stats.hits + stats.misses;
+	std::cout << "Tile cache: " << stats.hits << " hits of " << lookups << " tiles ("
+	          << (lookups > 0 ? 100.0 * stats.hits / lookups : 0.0) << "%), " << stats.bytesRead << " bytes of counts read instead of "
+	          << stats.iterationsSaved << " iterations" << std::endl;
+	std::cout << "Tile cache: " << stats.bytesWritten << " bytes written, " << stats.evicted << " tiles dropped, "
+	          << cache.sizeBytes() / (1024 * 1024) << "MB in " << cache.directory() << std::endl;
+}
+
 void write_time() {
+	TraceScope scope("write_time");
 	std::ofstream outfile;
 
 	// change / to '\\' on windows
@@ -56,196 +292,1709 @@ void write_time() {
 	outfile.close();
 }
 
-// write mandelbrot to .tga file
-void write_tga(const std::string& name) {
+// Puts the iteration counts for count pixels of row y (x0, x0 + step and so on) into out,
+// using whichever kernel the settings call for
+void run_kernel(int firstRow, const RenderSettings& settings, int x0, int step, int y, int count, KernelStats& stats,
+                uint32_t* out) {
+	const View& view = settings.view;
+	const double dx = (view.right - view.left) / view.width; // distance between pixels on the real axis
+
+	// Work out the imaginary part of the points on this row of the output image
+	const double ci = view.top + ((firstRow + y) * (view.bottom - view.top) / view.height);
+
+	if (settings.reference != nullptr) {
+		perturb_row(*settings.reference, x0, step, firstRow + y, count, settings.maxIt, stats, out);
+	} else if (settings.preciseKernel != nullptr) {
+		settings.preciseKernel(settings.precise, x0, step, firstRow + y, count, settings.maxIt, settings.options, stats, out);
+	} else {
+		settings.kernel(view.left, dx, x0, step, ci, count, settings.maxIt, settings.options, stats, out);
+	}
+}
+
+// Works out count pixels of row y starting at x0 and colours them in
+// (unless colourIn is false, then they're left as iteration counts).
+void compute_span(Framebuffer& image, int firstRow, const RenderSettings& settings, int x0, int y, int count,
+                  KernelStats& stats, bool colourIn = true) {
+	// the kernel writes how many iterations each pixel took straight into the row...
+	uint32_t* row = image.row(y) + x0;
+	run_kernel(firstRow, settings, x0, 1, y, count, stats, row);
+	if (!colourIn) {
+		return;
+	}
+
+	// ...which then get swapped out for colours
+	for (int i = 0; i < count; ++i) {
+		if (row[i] == uint32_t(settings.maxIt)) {
+			// z didn't escape the circle therefore point is in mandelbrot set
+			row[i] = settings.colour;
+		} else {
+			// z escaped within < MAX_IT, the point isn't in the set
+			row[i] = 0x000000;
+		}
+	}
+}
+
+// The tile cache's key for a render, anything that changes a pixel's count has to be in here (the SIMD and scalar
+// kernels give the same counts, so which one ran doesn't) and the doubles go in as hex so they're exact.
+// A deep zoom needs the reference orbit's centre adding on.
+std::string cache_key(const RenderSettings& settings, Precision precision) {
+	const View& view = settings.view;
+	const KernelOptions& options = settings.options;
+	std::ostringstream key;
+	key << std::hexfloat << "kernel " << kernelVersion << " max-it " << settings.maxIt << " power " << options.power
+	    << " cull " << options.cullInterior << " period-tol " << options.periodTolerance
+	    << " julia " << (options.fractal == Fractal::Julia) << " " << options.juliaRe << " " << options.juliaIm
+	    << " view " << view.left << " " << view.right << " " << view.top << " " << view.bottom << " " << view.width << " " << view.height;
+	if (settings.reference == nullptr) {
+		key << " precision " << precision_name(precision);
+	}
+	if (settings.reference == nullptr && settings.preciseKernel != nullptr) {
+		const PreciseView& precise = settings.precise;
+		key << " precise " << precise.leftHi << " " << precise.leftLo << " " << precise.topHi << " " << precise.topLo
+		    << " " << precise.dx << " " << precise.dy;
+	}
+	return key.str();
+}
+
+// The top left corner of a view, centre - toLeft + (centreIm + toTop) i, worked out with bits bits after the point
+// and split into the nearest doubles and what they're off by. Returns false if the centre couldn't be read.
+bool precise_corner(const std::string& centreRe, const std::string& centreIm, const BigFixed& toLeft, const BigFixed& toTop,
+                    int bits, PreciseView& precise) {
+	BigFixed preciseLeft;
+	BigFixed preciseTop;
+	if (!BigFixed::parse(centreRe, bits, preciseLeft) || !BigFixed::parse(centreIm, bits, preciseTop)) {
+		return false;
+	}
+	preciseLeft = preciseLeft - toLeft;
+	preciseTop = preciseTop + toTop;
+	precise.leftHi = preciseLeft.to_double();
+	precise.leftLo = (preciseLeft - BigFixed::from_double(precise.leftHi, bits)).to_double();
+	precise.topHi = preciseTop.to_double();
+	precise.topLo = (preciseTop - BigFixed::from_double(precise.topHi, bits)).to_double();
+	return true;
+}
+
+// compute() when there's a tile cache: the counts come off disk if this tile has been done before and otherwise
+// get worked out and stored for next time, either way they're coloured in afterwards
+void compute_cached(Framebuffer& image, int firstRow, const RenderSettings& settings, const Tile& tile, KernelStats& stats) {
+	// where the tile is in the whole picture (the key has the whole picture's view in it too), so a band's tiles find
+	// the same entries as the full image's as long as the bands are a whole number of tiles high, and any other view
+	// (even one that's only panned by a pixel) has entries of its own
+	std::ostringstream key;
+	key << settings.cacheKey << " tile " << tile.x0 << " " << firstRow + tile.y0 << " " << tile.x1 << " " << firstRow + tile.y1;
+
+	if (!settings.cache->load(key.str(), image, tile)) {
+		const uint64_t before = stats.iterations;
+		for (int y = tile.y0; y < tile.y1; ++y) {
+			compute_span(image, firstRow, settings, tile.x0, y, tile.x1 - tile.x0, stats, false);
+		}
+		settings.cache->store(key.str(), image, tile, stats.iterations - before);
+	}
+
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		uint32_t* row = image.row(y);
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			row[x] = (row[x] == uint32_t(settings.maxIt)) ? settings.colour : 0x000000;
+		}
+	}
+}
+
+// Render one tile of the Mandelbrot set into the image array.
+// Row 0 of the image is row firstRow of the whole picture (it's only ever non-zero when rendering in bands).
+// Iteration counts and the like get added to stats.
+void compute(Framebuffer& image, int firstRow, const RenderSettings& settings, const Tile& tile, KernelStats& stats) {
+	if (settings.cache != nullptr) {
+		compute_cached(image, firstRow, settings, tile, stats);
+		return;
+	}
+
+	const int MAX_IT = settings.maxIt;
+
+	const View& view = settings.view;
+	const EscapeRowFn kernel = settings.kernel;
+	const int colour = settings.colour;
+
+	const double left = view.left;
+	const double top = view.top;
+	const double bottom = view.bottom;
+	const int height = view.height;
+
+	const double dx = (view.right - left) / view.width; // distance between pixels on the real axis
+
+	if (settings.traversal == Traversal::Columns && settings.reference == nullptr && settings.preciseKernel == nullptr) {
+		// the old column by column order, only kept to compare against
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			for (int y = tile.y0; y < tile.y1; ++y) {
+				const double ci = top + ((firstRow + y) * (bottom - top) / height);
+				uint32_t& pixel = image.row(y)[x];
+				kernel(left, dx, x, 1, ci, 1, MAX_IT, settings.options, stats, &pixel);
+				pixel = (pixel == uint32_t(MAX_IT)) ? colour : 0x000000;
+			}
+		}
+		return;
+	}
+
+	// go along the rows so the kernel can do several neighbouring pixels at once
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		compute_span(image, firstRow, settings, tile.x0, y, tile.x1 - tile.x0, stats);
+	}
+}
+
+// true if every pixel round the edge of the tile has the same value as its top left corner
+bool uniform_border(const Framebuffer& image, const Tile& tile) {
+	const uint32_t first = image.row(tile.y0)[tile.x0];
+	const uint32_t* top = image.row(tile.y0);
+	const uint32_t* bottom = image.row(tile.y1 - 1);
+	for (int x = tile.x0; x < tile.x1; ++x) {
+		if (top[x] != first || bottom[x] != first) {
+			return false;
+		}
+	}
+	for (int y = tile.y0 + 1; y < tile.y1 - 1; ++y) {
+		if (image.row(y)[tile.x0] != first || image.row(y)[tile.x1 - 1] != first) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// true if the point 0 (which is always in the set) falls inside the tile
+// a tile like that can have a border that's entirely outside the set and still have the whole set inside it
+bool covers_origin(int firstRow, const RenderSettings& settings, const Tile& tile) {
+	const View& view = settings.view;
+	const double dx = (view.right - view.left) / view.width;
+	const double dy = (view.bottom - view.top) / view.height;
+	const double x0 = view.left + tile.x0 * dx;
+	const double x1 = view.left + (tile.x1 - 1) * dx;
+	const double y0 = view.top + (firstRow + tile.y0) * dy;
+	const double y1 = view.top + (firstRow + tile.y1 - 1) * dy;
+	return std::min(x0, x1) <= 0 && std::max(x0, x1) >= 0 && std::min(y0, y1) <= 0 && std::max(y0, y1) >= 0;
+}
+
+// Mariani-Silver subdivision. Everything that takes at least a given number of iterations to escape (the set
+// included) is connected with no holes, so if the whole border of a rectangle took the same number of iterations
+// then so did the inside. Each tile's border gets computed; if it's all one count the inside is filled in, otherwise
+// the tile is cut in half across its longer side, the dividing line is computed and one half goes back on the
+// scheduler for anyone to take while this thread carries on with the other. Both halves share their edges with
+// the parent (and each other), so the only new pixels each split needs are on the dividing line (columns are
+// done columnWidth wide, which costs the SIMD kernels about the same as one pixel).
+// Output is identical to compute(), as long as the kernel gives the same answer for a pixel wherever it
+// falls in a row (which is why kernel.cpp is built without fused multiply-adds).
+// The pixels are left as iteration counts, colour_rows() has to be run over the image once every tile's done.
+void subdivide(TileScheduler& scheduler, int worker, Framebuffer& image, int firstRow, const RenderSettings& settings,
+               Tile tile, KernelStats& stats) {
+	if (tile.depth == 0) {
+		// a fresh tile from the scheduler, nothing's been computed yet
+		const int width = tile.x1 - tile.x0;
+		if (width < 2 * columnWidth + minSubdivide || tile.y1 - tile.y0 < 2 + minSubdivide) {
+			for (int y = tile.y0; y < tile.y1; ++y) {
+				compute_span(image, firstRow, settings, tile.x0, y, width, stats, false);
+			}
+			return;
+		}
+
+		// the top and bottom rows and a column down each side, then carry on with what's between the columns
+		// (its left and right edges are the inner edges of the columns)
+		compute_span(image, firstRow, settings, tile.x0, tile.y0, width, stats, false);
+		compute_span(image, firstRow, settings, tile.x0, tile.y1 - 1, width, stats, false);
+		for (int y = tile.y0 + 1; y < tile.y1 - 1; ++y) {
+			compute_span(image, firstRow, settings, tile.x0, y, columnWidth, stats, false);
+			compute_span(image, firstRow, settings, tile.x1 - columnWidth, y, columnWidth, stats, false);
+		}
+		tile.x0 += columnWidth - 1;
+		tile.x1 -= columnWidth - 1;
+	}
+
+	while (true) {
+		// from here on the tile's border is always done, just the inside is left
+		const Tile inside = { tile.x0 + 1, tile.y0 + 1, tile.x1 - 1, tile.y1 - 1, tile.depth };
+		if (inside.x1 <= inside.x0 || inside.y1 <= inside.y0) {
+			return;
+		}
+
+		const uint32_t corner = image.row(tile.y0)[tile.x0];
+		const bool uniform = uniform_border(image, tile);
+		if (uniform && corner != uint32_t(settings.maxIt) && !covers_origin(firstRow, settings, tile)) {
+			for (int y = inside.y0; y < inside.y1; ++y) {
+				std::fill(image.row(y) + inside.x0, image.row(y) + inside.x1, corner);
+			}
+			return;
+		}
+
+		// a border that never escaped doesn't get filled: the slow-escaping points near the edge of the set have specks
+		// thinner than a pixel that the border can step over, and the cardioid test and cycle check make most of the
+		// inside cheap to compute anyway
+		if (uniform || inside.x1 - inside.x0 < minSubdivide || inside.y1 - inside.y0 < minSubdivide) {
+			// not worth splitting any further
+			for (int y = inside.y0; y < inside.y1; ++y) {
+				compute_span(image, firstRow, settings, inside.x0, y, inside.x1 - inside.x0, stats, false);
+			}
+			return;
+		}
+
+		Tile first = tile;
+		Tile second = tile;
+		first.depth = second.depth = tile.depth + 1;
+		if (tile.x1 - tile.x0 >= tile.y1 - tile.y0 && inside.x1 - inside.x0 >= columnWidth + 2 * minSubdivide) {
+			// split down a column in the middle, the halves start from either side of it
+			const int mid = (tile.x0 + tile.x1 - columnWidth) / 2;
+			for (int y = inside.y0; y < inside.y1; ++y) {
+				compute_span(image, firstRow, settings, mid, y, columnWidth, stats, false);
+			}
+			first.x1 = mid + 1;
+			second.x0 = mid + columnWidth - 1;
+		} else {
+			// split along the middle row
+			const int mid = (tile.y0 + tile.y1) / 2;
+			compute_span(image, firstRow, settings, inside.x0, mid, inside.x1 - inside.x0, stats, false);
+			first.y1 = mid + 1;
+			second.y0 = mid;
+		}
+
+		scheduler.push(worker, second);
+		tile = first;
+	}
+}
+
+// swaps the iteration counts left behind by subdivide() for colours
+void colour_rows(Framebuffer& image, int rows, const RenderSettings& settings) {
+	for (int y = 0; y < rows; ++y) {
+		uint32_t* row = image.row(y);
+		for (int x = 0; x < image.width(); ++x) {
+			row[x] = (row[x] == uint32_t(settings.maxIt)) ? settings.colour : 0x000000;
+		}
+	}
+}
+
+// One tile's share of a progressive pass: the pixels with both coordinates a multiple of step, apart from the ones
+// the pass before (at twice the step) already did, left as iteration counts. scratch holds the counts for pixels
+// that aren't next to each other until they're put in place.
+void compute_pass(Framebuffer& image, const RenderSettings& settings, const Tile& tile, int step, bool firstPass,
+                  KernelStats& stats, std::vector<uint32_t>& scratch) {
+	for (int y = (tile.y0 + step - 1) / step * step; y < tile.y1; y += step) {
+		// rows the coarser pass went along only have the pixels between its samples left
+		const bool coarseRow = !firstPass && y % (2 * step) == 0;
+		const int stride = coarseRow ? 2 * step : step;
+		const int offset = coarseRow ? step : 0;
+
+		int x0 = tile.x0 - tile.x0 % stride + offset;
+		if (x0 < tile.x0) {
+			x0 += stride;
+		}
+		if (x0 >= tile.x1) {
+			continue;
+		}
+		const int count = (tile.x1 - 1 - x0) / stride + 1;
+
+		if (stride == 1) {
+			run_kernel(0, settings, x0, 1, y, count, stats, image.row(y) + x0);
+			continue;
+		}
+		scratch.resize(size_t(count));
+		run_kernel(0, settings, x0, stride, y, count, stats, scratch.data());
+		uint32_t* row = image.row(y);
+		for (int i = 0; i < count; ++i) {
+			row[x0 + i * stride] = scratch[size_t(i)];
+		}
+	}
+}
+
+// thread function for one pass of a progressive render
+void progressive_worker(TileScheduler* scheduler, Framebuffer* image, int worker, const RenderSettings* settings, int step,
+                        bool firstPass, KernelStats* stats) {
+	PerfScope counters(PerfPhase::Compute);
+	Tile tile = {};
+	KernelStats local = {};
+	std::vector<uint32_t> scratch;
+	while (scheduler->next(worker, tile)) {
+		TraceScope scope("tile");
+		compute_pass(*image, *settings, tile, step, firstPass, local, scratch);
+	}
+	*stats += local;
+}
+
+// Blows the samples a progressive pass has got up to out into a whole picture, every pixel takes the colour of the
+// sample at the top left of its step by step block
+void fill_preview(const Framebuffer& image, Framebuffer& preview, int step, const RenderSettings& settings) {
+	for (int y = 0; y < image.height(); ++y) {
+		const uint32_t* samples = image.row(y - y % step);
+		uint32_t* row = preview.row(y);
+		for (int x = 0; x < image.width(); ++x) {
+			row[x] = (samples[x - x % step] == uint32_t(settings.maxIt)) ? settings.colour : 0x000000;
+		}
+	}
+}
+
+// thread function, keeps pulling tiles off the scheduler (stealing when its own run out) until the image is done
+// the counters are kept in this thread's own copy so there's no sharing in the hot loop, and get added to stats at the end
+// (two clock reads a tile, which is nothing next to the 4096 pixels in it)
+void render_worker(TileScheduler* scheduler, Framebuffer* image, int firstRow, int worker, const RenderSettings* settings,
+                   WorkerStats* stats) {
+	PerfScope counters(PerfPhase::Compute); // a thread's whole share, so the counters are only read twice
+	Tile tile = {};
+	WorkerStats local = {};
+	theClock::time_point waiting = theClock::now();
+	while (scheduler->next(worker, tile)) {
+		const theClock::time_point started = theClock::now();
+		local.idle += started - waiting;
+		++local.tiles;
+		{
+			TraceScope scope("tile");
+			if (settings->subdivide) {
+				subdivide(*scheduler, worker, *image, firstRow, *settings, tile, local.kernel);
+			} else {
+				compute(*image, firstRow, *settings, tile, local.kernel);
+			}
+		}
+		waiting = theClock::now();
+		local.busy += waiting - started;
+	}
+	local.idle += theClock::now() - waiting;
+	*stats += local;
+}
+
+// writer thread for the banded mode, adds how long it took on to encodeTime
+void write_band(std::ofstream* outfile, const Framebuffer* band, int rows, bool ppm, bool rle, theClock::duration* encodeTime) {
+	TraceScope scope("write band");
+	PerfScope counters(PerfPhase::Encode);
+	theClock::time_point start = theClock::now();
+	if (rle) {
+		write_rows_rle(*outfile, *band, rows);
+	} else {
+		write_rows(*outfile, *band, rows, ppm);
+	}
+	*encodeTime += theClock::now() - start;
+}
+
+// Renders the image a band of rows at a time and appends each band to the file as soon as it's done, so an image
+// bigger than memory can still be made. Two bands are kept so one can be written while the next one is computed.
+// Images too big for a TGA header are written as PPM instead (which has no RLE, so rle is ignored for those).
+// Returns how long was spent writing, most of which overlaps with computing, puts the file size in bytesWritten
+// and adds each thread's counters over all the bands to workerStats (which needs to have threadNum of them).
+theClock::duration render_banded(ThreadPool& pool, const std::string& name, const RenderSettings& settings, int threadNum,
+                                 Partition partition, size_t budgetBytes, bool hugePages, bool rle, size_t* bytesWritten,
+                                 std::vector<WorkerStats>* workerStats) {
+	const int width = settings.view.width;
+	const int height = settings.view.height;
+	const bool ppm = !fits_tga(width, height);
+	rle = rle && !ppm;
+
+	// half the budget for each band, but always at least one row
+	// a whole number of tiles when there's room for that, so the bands cut the image into the same tiles a full render
+	// would (which is what lets the tile cache share its entries between the two)
+	const size_t rowBytes = (size_t(width) + Framebuffer::linePixels - 1) / Framebuffer::linePixels * Framebuffer::linePixels * sizeof(uint32_t);
+	int bandRows = int(std::max<size_t>(1, std::min<size_t>(height, budgetBytes / 2 / rowBytes)));
+	if (bandRows < height && bandRows > tileSize) {
+		bandRows -= bandRows % tileSize;
+	}
+	const int bandCount = (height + bandRows - 1) / bandRows;
+
+	std::cout << "Rendering in " << bandCount << " bands of " << bandRows << " rows" << std::endl;
+
+	Framebuffer bandA(width, bandRows, hugePages);
+	Framebuffer bandB(width, bandRows, hugePages);
+	Framebuffer* bands[2] = { &bandA, &bandB };
 
 	std::ofstream outfile(name, std::ofstream::binary);
+	if (ppm) {
+		write_ppm_header(outfile, width, height);
+	} else {
+		write_tga_header(outfile, width, height, rle);
+	}
+
+	theClock::duration encodeTime(0);
+	TaskGroup writer(pool);
+	for (int b = 0; b < bandCount; ++b) {
+		Framebuffer& band = *bands[b % 2];
+		const int firstRow = b * bandRows;
+		const int rows = std::min(bandRows, height - firstRow);
 
-	uint8_t header[18] = {
-		0, //no image ID
-		0, //no colour map
-		2, //uncompressed 24-bit image
-		0, 0, 0, 0, 0, //empty colour map specification
-		0, 0, //X origin
-		0, 0, //Y origin
-		width & 0xFF, width >> 8 & 0xFF, //width
-		height & 0xFF, height >> 8 & 0xFF, //height
-		24, //bits per pixel
-		0, //image descriptor
-	};
-	outfile.write((const char*)header, 18);
-
-	// converted to range based thanks to clang-tidy :)
-	for (auto& y : image) {
-		for (unsigned int x : y) {
-			uint8_t pixel[3] = {
-					static_cast<uint8_t>(x & 0xFF), // blue channel
-					static_cast<uint8_t>(x >> 8 & 0xFF), // green channel
-					static_cast<uint8_t>(x >> 16 & 0xFF), // red channel
-			};
-			outfile.write((const char*)pixel, 3);
+		TileScheduler scheduler(threadNum, width, rows, tileSize, partition, Framebuffer::linePixels);
+		TaskGroup workers(pool);
+		{
+			TraceScope scope("start workers");
+			for (int i = 0; i < threadNum; ++i) {
+				workers.run(std::bind(render_worker, &scheduler, &band, firstRow, i, &settings, &(*workerStats)[size_t(i)]));
+			}
 		}
+		{
+			TraceScope scope("wait for workers");
+			workers.wait();
+		}
+		if (settings.subdivide) {
+			colour_rows(band, rows, settings);
+		}
+
+		// the previous band has to be on disk before this one goes after it
+		// (and the buffer the next band uses is the one it was being written from)
+		writer.wait();
+		writer.run(std::bind(write_band, &outfile, &band, rows, ppm, rle, &encodeTime));
+
+		std::cout << "Band " << b + 1 << "/" << bandCount << " done" << std::endl;
 	}
+	writer.wait();
 
+	*bytesWritten = size_t(outfile.tellp());
 	outfile.close();
 
-	// error handling
 	if (!outfile)
 	{
-		// An error has occurred at some point
 		std::cout << "Error writing to " << name << std::endl;
 		exit(1);
 	}
 
+	return encodeTime;
 }
 
-// Render the Mandelbrot set into the image array.
-// The parameters specify the region on the complex plane to plot.
-void compute(double left, double right, double top, double bottom, int start, int end, int colour) {
+// Renders the image in passes that each fill in more of the pixels (see progressiveSteps), writing a blocky preview
+// to previewName + "_previewN" + the extension after every pass but the last, so there's something to look at long
+// before the whole thing is done. No pixel is worked out twice. Leaves the image as iteration counts for
+// colour_rows(), adds the kernel totals to stats and returns how long it took to get the first preview written.
+theClock::duration render_progressive(ThreadPool& pool, Framebuffer& image, const RenderSettings& settings, int threadNum,
+                                      Partition partition, const std::string& previewName, OutputFormat format, KernelStats* stats) {
+	const int width = image.width();
+	const int height = image.height();
+	const theClock::time_point start = theClock::now();
+	theClock::duration firstPreview(0);
 
-	int MAX_IT = 500; // the amount of times we iterate before we determine a point isn't in the set
+	Framebuffer preview(width, height, image.hugePages());
+	const int passCount = int(sizeof(progressiveSteps) / sizeof(progressiveSteps[0]));
+	for (int pass = 0; pass < passCount; ++pass) {
+		const int step = progressiveSteps[pass];
 
-	for (int x = start; x <= end; ++x) {
-		for (int y = 0; y < height; ++y) {
+		TileScheduler scheduler(threadNum, width, height, tileSize, partition, Framebuffer::linePixels);
+		TaskGroup workers(pool);
+		std::vector<KernelStats> threadStats(size_t(threadNum), KernelStats {});
+		for (int i = 0; i < threadNum; ++i) {
+			workers.run(std::bind(progressive_worker, &scheduler, &image, i, &settings, step, pass == 0, &threadStats[size_t(i)]));
+		}
+		workers.wait();
+		for (const KernelStats& threadStat : threadStats) {
+			*stats += threadStat;
+		}
+
+		if (step == 1) {
+			break; // the last pass is the real image
+		}
 
-			// Work out the point in the complex plane that corresponds to this pixel in the output image
-			std::complex<double> c(left + x * (right - left) / width, top + (y * (bottom - top) / height));
+		fill_preview(image, preview, step, settings);
+		const std::string name = previewName + "_preview" + std::to_string(pass + 1) + format_extension(format);
+		if (!write_image(name, preview, format, threadNum, nullptr, &pool)) {
+			std::cout << "Error writing to " << name << std::endl;
+			exit(1);
+		}
+		const theClock::duration elapsed = theClock::now() - start;
+		if (pass == 0) {
+			firstPreview = elapsed;
+		}
+		std::cout << "Preview " << pass + 1 << " (1/" << step * step << " of the pixels) written to " << name << " after "
+		          << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << "ms" << std::endl;
+	}
+	return firstPreview;
+}
 
-			// Start off z at (0, 0)
-			std::complex<double> z(0.0, 0.0);
+// One frame of an animation. Pixel (x, y) is at anchor + ((offsetX + frame_index(x, width)) * half,
+// (offsetY - frame_index(y, height)) * half) rather than left + x * dx. Every frame of a zoom shares the anchor, so
+// when one frame's spacing is exactly a power of two times the last's, the pixels that line up with the last frame's
+// are at exactly the same point (the same whole number times a power of two) and can be copied instead of computed.
+struct FrameView {
+	double anchorX; // the end of the zoom
+	double anchorY;
+	int offsetX; // where this frame's centre is, in half pixels from the anchor (always even)
+	int offsetY;
+	double half; // half the distance between neighbouring pixels
+};
+
+// where to zoom to and in how many frames, the first frame is the view the rest of the options set up
+struct Animation {
+	int frames;
+	double endX;
+	double endY;
+	double endRadius;
+};
+
+// how many half pixels x is from the middle of a row (or column) size pixels long, always even so that zooming in by 2
+// lands half the pixels on the last frame's (odd sizes put the middle pixel on the centre rather than between two)
+int frame_index(int x, int size) {
+	return 2 * x - size + (size & 1);
+}
 
-			// Iterate z = z^2 + c until z moves more than 2 units away from (0, 0), or we've iterated too many times.
-			int it = 0;
-			while (abs(z) < 2.0 && it < MAX_IT) {
-				z = (z * z) + c;
-				++it;
+// a pixel's coordinate the way the kernel will work it out (in floats for the float kernels)
+double frame_coordinate(double centre, int index, double half, bool single) {
+	if (single) {
+		return double(float(centre) + float(index) * float(half));
+	}
+	return centre + double(index) * half;
+}
+
+// the nearest even number of half pixels to distance, where a frame's centre goes relative to the anchor
+int half_pixels(double distance, double half) {
+	return 2 * int(std::lround(distance / half / 2));
+}
+
+// For each column (or row, with sign -1) of the new frame, the one in the previous frame at exactly the same point,
+// or -1 if there isn't one.
+void match_pixels(double anchor, int offset, double half, int oldOffset, double oldHalf, int size, int sign, bool single,
+                  std::vector<int>& matches) {
+	matches.assign(size_t(size), -1);
+	for (int i = 0; i < size; ++i) {
+		const double value = frame_coordinate(anchor, offset + sign * frame_index(i, size), half, single);
+		const int guess = int(std::lround((sign * ((value - anchor) / oldHalf - oldOffset) + size - (size & 1)) / 2));
+		for (int old = guess - 1; old <= guess + 1; ++old) {
+			if (old >= 0 && old < size &&
+			    frame_coordinate(anchor, oldOffset + sign * frame_index(old, size), oldHalf, single) == value) {
+				matches[size_t(i)] = old;
+				break;
 			}
+		}
+	}
+}
+
+// everything a thread needs for its tiles of one frame
+struct FrameJob {
+	FrameView view;
+	Framebuffer* image; // iteration counts for this frame
+	const Framebuffer* previous; // and the last one (nullptr for the first frame)
+	const std::vector<int>* columns; // match_pixels() from this frame's columns and rows to the previous frame's
+	const std::vector<int>* rows;
+};
+
+// Works out one tile of an animation frame, copying whatever lines up with the previous frame
+// and computing the rest in runs that are evenly spaced, so the kernels still get several pixels at a time.
+void compute_frame_tile(const FrameJob& job, const RenderSettings& settings, const Tile& tile, KernelStats& stats,
+                        uint64_t& reused, std::vector<int>& missing, std::vector<uint32_t>& scratch) {
+	const int width = settings.view.width;
+	const int height = settings.view.height;
+	const FrameView& view = job.view;
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		uint32_t* row = job.image->row(y);
+		const double ci = frame_coordinate(view.anchorY, view.offsetY - frame_index(y, height), view.half, false);
+		const int oldRow = job.previous != nullptr ? (*job.rows)[size_t(y)] : -1;
 
-			if (it == MAX_IT) {
-				// z didn't escape the circle therefore point is in mandelbrot set
-				image[y][x] = colour;
+		missing.clear();
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			const int oldColumn = oldRow >= 0 ? (*job.columns)[size_t(x)] : -1;
+			if (oldColumn >= 0) {
+				row[x] = job.previous->row(oldRow)[oldColumn];
+				++reused;
 			} else {
-				// z escaped within < MAX_IT, the point isn't in the set
-				image[y][x] = 0x000000;
+				missing.push_back(x);
 			}
 		}
+
+		for (size_t i = 0; i < missing.size();) {
+			const int stride = i + 1 < missing.size() ? missing[i + 1] - missing[i] : 1;
+			size_t end = i + 1;
+			while (end < missing.size() && missing[end] - missing[end - 1] == stride) {
+				++end;
+			}
+			const int count = int(end - i);
+			scratch.resize(size_t(count));
+			settings.kernel(view.anchorX, view.half, view.offsetX + frame_index(missing[i], width), 2 * stride, ci, count,
+			                settings.maxIt, settings.options, stats, scratch.data());
+			for (int j = 0; j < count; ++j) {
+				row[missing[i] + j * stride] = scratch[size_t(j)];
+			}
+			i = end;
+		}
 	}
-	std::cout << runThreadsCount.fetch_add(1) + 1 << std::endl;
+}
 
-	countLock.lock();
-	cv.notify_one();
-	countLock.unlock();
+// thread function for one animation frame
+void frame_worker(TileScheduler* scheduler, const FrameJob* job, int worker, const RenderSettings* settings,
+                  KernelStats* stats, uint64_t* reused) {
+	PerfScope counters(PerfPhase::Compute);
+	Tile tile = {};
+	KernelStats local = {};
+	uint64_t localReused = 0;
+	std::vector<int> missing;
+	std::vector<uint32_t> scratch;
+	while (scheduler->next(worker, tile)) {
+		TraceScope scope("tile");
+		compute_frame_tile(*job, *settings, tile, local, localReused, missing, scratch);
+	}
+	*stats += local;
+	*reused = localReused;
 }
 
-int main() {
-	std::cout << "CMP 202 Mandelbrot Set Generator - 2021 Isaac Basque-Rice" << std::endl;
+// writer thread for the animation, adds how long it took on to encodeTime and the file size on to bytesWritten
+void write_frame(std::string name, const Framebuffer* frame, OutputFormat format, int threads, ThreadPool* pool,
+                 theClock::duration* encodeTime, size_t* bytesWritten) {
+	TraceScope scope("write frame");
+	theClock::time_point start = theClock::now();
+	size_t bytes = 0;
+	if (!write_image(name, *frame, format, threads, &bytes, pool)) {
+		std::cout << "Error writing to " << name << std::endl;
+		exit(1);
+	}
+	*bytesWritten += bytes;
+	*encodeTime += theClock::now() - start;
+}
 
-	// the colour that the mandelbrot set will be made up of
-	int colour;
+// zooming by the same factor every frame, worked out by multiplying so a zoom of exactly 2 stays exact
+double zoom_factor(const Animation& animation, double startRadius) {
+	return animation.frames > 1 ? std::pow(animation.endRadius / startRadius, 1.0 / (animation.frames - 1)) : 1.0;
+}
 
-	// the name of the colour
-	std::string colourName;
-	
-	// colour values
-	const int white = 0xFFFFFF;
-	const int black = 0x0c0c0c; // not exactly black so it can stay visible
-	const int red = 0xFF0000;
-	const int orange = 0xFFA500;
-	const int yellow = 0xFFFF00;
-	const int green = 0x00FF00;
-	const int blue = 0x0000FF;
-	const int indigo = 0x4B0082;
-	const int violet = 0x8F00FF;
-
-	std::cout << "Colours: \n 1: White \n 2: Black \n 3: Red \n 4: Orange \n 5: Yellow \n 6: Green \n 7: Blue \n 8: Indigo \n 9: Violet" << std::endl;
-
-	std::cout << "Please choose a colour (1-9): " << std::endl;
-
-	std::cin >> colour;
-
-	switch (colour) {
-		case 1: colour = white; colourName = "White";
-			break;
-		case 2: colour = black; colourName = "Black";
-			break;
-		case 3: colour = red; colourName = "Red";
-			break;
-		case 4: colour = orange; colourName = "Orange";
-			break;
-		case 5: colour = yellow; colourName = "Yellow";
-			break;
-		case 6: colour = green; colourName = "Green";
-			break;
-		case 7: colour = blue; colourName = "Blue";
-			break;
-		case 8: colour = indigo; colourName = "Indigo";
-			break;
-		case 9: colour = violet; colourName = "Violet";
-			break;
-		default: colour = white; colourName = "White";
-			break;
-	}
-
-	int numIn = 0;
-	std::cout << "How many threads would you like to use?:" << std::endl;
+// why the frames of a zoom can't copy pixels from the one before, empty if they can
+std::string frame_reuse_problem(const Animation& animation, double startRadius) {
+	int exponent = 0;
+	if (animation.frames > 1 && std::frexp(zoom_factor(animation, startRadius), &exponent) != 0.5) {
+		return "the zoom from one frame to the next isn't a power of two, so hardly any pixels line up to be reused";
+	}
+	return "";
+}
 
-	while (true) {
-		std::cin >> numIn;
-		if (numIn == 0) {
-			std::cout << "0 Is not a valid input" << std::endl;
+// Renders a zoom from (startX, startY) (the radius being half the height of the view) to the end of animation,
+// zooming by the same factor every frame and moving the centre along with the zoom, and writes the frames to
+// name + "_frame0000" and so on. Each frame is written while the next one is computed.
+// Every frame's centre is rounded to the nearest pixel on a grid through the end of the zoom (see FrameView).
+// single is true if the kernel is a float one, which changes which pixels line up.
+// Returns how long was spent writing, adds the kernel totals to stats and the pixels copied from one frame to the
+// next to reused.
+theClock::duration render_animation(ThreadPool& pool, const RenderSettings& settings, bool single, double startX, double startY,
+                                    double startRadius, const Animation& animation, int threadNum, Partition partition, bool hugePages,
+                                    OutputFormat format, const std::string& name, KernelStats* stats, uint64_t* reused,
+                                    size_t* bytesWritten) {
+	const int width = settings.view.width;
+	const int height = settings.view.height;
+
+	// iteration counts for this frame and the last, and the colours of the one being written
+	Framebuffer countsA(width, height, hugePages);
+	Framebuffer countsB(width, height, hugePages);
+	Framebuffer colours(width, height, hugePages);
+	Framebuffer* current = &countsA;
+	Framebuffer* previous = &countsB;
+
+	const double factor = zoom_factor(animation, startRadius);
+	double radius = startRadius;
+	FrameView last = {};
+
+	std::vector<int> columns;
+	std::vector<int> rows;
+	theClock::duration encodeTime(0);
+	TaskGroup writer(pool);
+	for (int frame = 0; frame < animation.frames; ++frame) {
+		// the centre moves in step with the zoom, so it gets to the end exactly as the radius does
+		const double progress = startRadius != animation.endRadius ? (startRadius - radius) / (startRadius - animation.endRadius)
+		                                                          : double(frame) / std::max(1, animation.frames - 1);
+		const double half = radius / height;
+		const double centreX = startX + (animation.endX - startX) * progress;
+		const double centreY = startY + (animation.endY - startY) * progress;
+		const FrameView view = { animation.endX, animation.endY, half_pixels(centreX - animation.endX, half),
+		                         half_pixels(centreY - animation.endY, half), half };
+
+		FrameJob job = { view, current, frame > 0 ? previous : nullptr, &columns, &rows };
+		if (frame > 0) {
+			match_pixels(view.anchorX, view.offsetX, view.half, last.offsetX, last.half, width, 1, single, columns);
+			match_pixels(view.anchorY, view.offsetY, view.half, last.offsetY, last.half, height, -1, false, rows);
+		}
+
+		TileScheduler scheduler(threadNum, width, height, tileSize, partition, Framebuffer::linePixels);
+		TaskGroup workers(pool);
+		std::vector<KernelStats> threadStats(size_t(threadNum), KernelStats {});
+		std::vector<uint64_t> threadReused(size_t(threadNum), 0);
+		for (int i = 0; i < threadNum; ++i) {
+			workers.run(std::bind(frame_worker, &scheduler, &job, i, &settings, &threadStats[size_t(i)], &threadReused[size_t(i)]));
+		}
+		workers.wait();
+		for (int i = 0; i < threadNum; ++i) {
+			*stats += threadStats[size_t(i)];
+			*reused += threadReused[size_t(i)];
+		}
+
+		// the last frame has to be written out before its colours get replaced
+		writer.wait();
+		for (int y = 0; y < height; ++y) {
+			const uint32_t* counts = current->row(y);
+			uint32_t* row = colours.row(y);
+			for (int x = 0; x < width; ++x) {
+				row[x] = (counts[x] == uint32_t(settings.maxIt)) ? settings.colour : 0x000000;
+			}
+		}
+		std::ostringstream frameName;
+		frameName << name << "_frame" << std::setw(4) << std::setfill('0') << frame << format_extension(format);
+		writer.run(std::bind(write_frame, frameName.str(), &colours, format, threadNum, &pool, &encodeTime, bytesWritten));
+
+		std::swap(current, previous);
+		last = view;
+		radius *= factor;
+	}
+	writer.wait();
+	return encodeTime;
+}
+
+// what --serve needs to turn a map tile's address into a render
+struct MapSettings {
+	RenderSettings base; // everything apart from the view, kernels and period tolerance
+	std::string centreRe; // the middle of the map
+	std::string centreIm;
+	double half; // half the width of the map, which is square
+	KernelType kernelType;
+	bool autoPrecision;
+	Precision precision; // used for every tile unless autoPrecision
+	double periodTolerance; // before it's cut down to suit the tile's pixel spacing
+	std::atomic<uint64_t>* iterations; // summed over every tile rendered
+};
+
+// Draws one tile of the --serve map through compute(), so it gets the same kernels (and tile cache) as a whole render.
+// Each zoom level halves the pixel spacing and every tile picks the cheapest number type that can manage it, returns
+// false for a tile past what double-double can do.
+bool render_map_tile(const MapTile& tile, Framebuffer& image, const MapSettings& map) {
+	const double spacing = std::ldexp(map.half, 1 - tile.z) / mapTileSize;
+	const double tileSide = mapTileSize * spacing;
+	const double centreX = std::atof(map.centreRe.c_str());
+	const double centreY = std::atof(map.centreIm.c_str());
+	const double left = centreX - map.half + tile.x * tileSide;
+	const double top = centreY + map.half - tile.y * tileSide;
+
+	RenderSettings settings = map.base;
+	settings.view = { left, left + tileSide, top, top - tileSide, mapTileSize, mapTileSize };
+
+	Precision precision = map.precision;
+	const double scale = std::max(std::max(std::fabs(left), std::fabs(left + tileSide)), std::max(std::fabs(top), std::fabs(top - tileSide)));
+	if (map.autoPrecision && !choose_precision(scale, spacing, precision)) {
+		return false;
+	}
+	settings.options.periodTolerance = std::min(map.periodTolerance, spacing * periodToleranceSpacing);
+	settings.kernel = kernel_function(map.kernelType, precision, settings.options, settings.maxIt);
+	settings.preciseKernel = precision_has_row_kernel(precision) ? nullptr : precise_function(precision, settings.options);
+	settings.precise = { left, 0.0, top, 0.0, spacing, -spacing };
+	if (settings.preciseKernel != nullptr) {
+		// the distance from the centre to the tile's corner is the half width scaled by 1 - 2x / 2^z, both exact as doubles
+		const int bits = std::max(0, int(std::ceil(-std::log2(spacing)))) + 2 * precision_bits(precision);
+		const BigFixed half = BigFixed::from_double(map.half, bits);
+		if (!precise_corner(map.centreRe, map.centreIm, half * BigFixed::from_double(1.0 - std::ldexp(tile.x, 1 - tile.z), bits),
+		                    half * BigFixed::from_double(1.0 - std::ldexp(tile.y, 1 - tile.z), bits), bits, settings.precise)) {
+			return false;
+		}
+	}
+	settings.cacheKey = cache_key(settings, precision);
+
+	KernelStats stats = {};
+	const Tile whole = { 0, 0, mapTileSize, mapTileSize, 0 };
+	compute(image, 0, settings, whole, stats);
+	*map.iterations += stats.iterations;
+	return true;
+}
+
+// one thread count's timings in a --sweep
+struct SweepPoint {
+	int threads;
+	double medianMs;
+	double minMs;
+	double maxMs;
+	double imbalance; // max busy / mean busy, the median over the renders
+};
+
+// Renders the image (compute only, nothing gets written) reps times at each of the thread counts and prints how the
+// median time scales against the first count: the speedup, the parallel efficiency (speedup / threads) and the
+// Karp-Flatt serial fraction, (1/speedup - 1/threads) / (1 - 1/threads), which stays flat if the overhead is a fixed
+// serial part and grows if it's something that gets worse with more threads (contention, imbalance, which gets its
+// own column as the longest any thread was busy over the average). The table also
+// goes to csvName if it isn't empty. Returns false if the CSV couldn't be written.
+bool run_sweep(ThreadPool& pool, const RenderSettings& settings, const std::vector<int>& threadCounts, int reps,
+               Partition partition, bool hugePages, const std::string& csvName) {
+	const int width = settings.view.width;
+	const int height = settings.view.height;
+	Framebuffer image(width, height, hugePages);
+	pool.reserve(threadCounts.back());
+
+	std::vector<SweepPoint> points;
+	for (int threads : threadCounts) {
+		std::vector<double> times;
+		std::vector<double> imbalances;
+		for (int rep = 0; rep <= reps; ++rep) {
+			TileScheduler scheduler(threads, width, height, tileSize, partition, Framebuffer::linePixels);
+			std::vector<WorkerStats> threadStats(size_t(threads), WorkerStats {});
+
+			theClock::time_point start = theClock::now();
+			TaskGroup workers(pool);
+			for (int i = 0; i < threads; ++i) {
+				workers.run(std::bind(render_worker, &scheduler, &image, 0, i, &settings, &threadStats[size_t(i)]));
+			}
+			workers.wait();
+			theClock::time_point end = theClock::now();
+
+			if (rep > 0) {
+				// the first run is a warmup (page faults on the image, the pool's threads waking up)
+				times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+				double maxBusy = 0.0;
+				double meanBusy = 0.0;
+				imbalances.push_back(load_imbalance(threadStats, maxBusy, meanBusy));
+			}
+		}
+		std::sort(times.begin(), times.end());
+		std::sort(imbalances.begin(), imbalances.end());
+		const size_t mid = times.size() / 2;
+		const double median = times.size() % 2 == 1 ? times[mid] : (times[mid - 1] + times[mid]) / 2;
+		points.push_back({ threads, median, times.front(), times.back(), imbalances[mid] });
+		std::cout << threads << " threads: " << median << "ms" << std::endl;
+	}
+
+	std::ofstream csv;
+	if (!csvName.empty()) {
+		csv.open(csvName);
+		csv << "threads,median_ms,min_ms,max_ms,imbalance,speedup,efficiency,karp_flatt\n";
+	}
+
+	// everything's measured against the first count, which is 1 unless the sweep was told otherwise
+	const SweepPoint& base = points.front();
+	std::cout << std::endl << std::setw(8) << "threads" << std::setw(12) << "median ms" << std::setw(12) << "min ms"
+	          << std::setw(12) << "max ms" << std::setw(11) << "imbalance" << std::setw(10) << "speedup" << std::setw(12) << "efficiency"
+	          << std::setw(12) << "Karp-Flatt" << std::endl;
+	for (const SweepPoint& point : points) {
+		const double p = double(point.threads) / base.threads;
+		const double speedup = point.medianMs > 0 ? base.medianMs / point.medianMs : 0.0;
+		const double efficiency = speedup / p;
+		const bool serialFraction = p > 1 && speedup > 0;
+		const double karpFlatt = serialFraction ? (1 / speedup - 1 / p) / (1 - 1 / p) : 0.0;
+
+		std::cout << std::fixed << std::setprecision(2) << std::setw(8) << point.threads << std::setw(12) << point.medianMs
+		          << std::setw(12) << point.minMs << std::setw(12) << point.maxMs << std::setw(11) << point.imbalance
+		          << std::setw(10) << speedup
+		          << std::setw(12) << efficiency << std::setprecision(3) << std::setw(12);
+		if (serialFraction) {
+			std::cout << karpFlatt << std::endl;
 		} else {
-			break;
+			std::cout << "-" << std::endl; // not defined for the count everything is measured against
+		}
+		if (csv.is_open()) {
+			csv << point.threads << "," << point.medianMs << "," << point.minMs << "," << point.maxMs << "," << point.imbalance << ","
+			    << speedup << ","
+			    << efficiency << ",";
+			if (serialFraction) {
+				csv << karpFlatt;
+			}
+			csv << "\n";
 		}
 	}
+	std::cout.unsetf(std::ios_base::floatfield);
+	std::cout << std::setprecision(6);
 
-	std::cout << "Generating a " << colourName << " Mandelbrot Set, using " << numIn << " threads..." << std::endl;
-	std::cout << "Completed Threads:" << std::endl;
+	if (csv.is_open()) {
+		csv.close();
+		if (!csv) {
+			std::cout << "Error writing to " << csvName << std::endl;
+			return false;
+		}
+		std::cout << "Sweep written to " << csvName << std::endl;
+	}
+	return true;
+}
+
+// everything the command line (or a job in a --jobs file) says about one render
+struct JobOptions {
+	// by default tiles are lined up with cache lines and filled in row by row
+	// --strips and --columns bring back the old column strips and column order to compare against
+	Partition partition = Partition::Tiles;
+	Traversal traversal = Traversal::Rows;
+	int width = defaultWidth;
+	int height = defaultHeight;
+	bool hugePages = true;
+	bool banded = false;
+	bool progressive = false;
+	Animation animation = { 0, 0.0, 0.0, 0.0 }; // no frames means no animation
+	OutputFormat format = OutputFormat::TGA;
+	int maxIt = defaultMaxIt;
+	bool cullInterior = true;
+	bool subdivideTiles = false;
+	bool forceDeep = false;
+	int power = 2;
+	bool julia = false;
+	double juliaRe = 0.0;
+	double juliaIm = 0.0;
+	bool autoPrecision = true;
+	Precision precision = Precision::Double;
+	std::string centreRe;
+	std::string centreIm;
+	std::string radius;
+	double periodTolerance = defaultPeriodTolerance;
+	size_t bandBudget = size_t(defaultBandMB) * 1024 * 1024;
+	std::string cacheDir; // empty for no tile cache
+	uint64_t cacheBudget = uint64_t(defaultCacheMB) * 1024 * 1024;
+	int servePort = 0; // 0 for a normal render
+	int serveQueue = defaultServeQueue;
+	int colourChoice = 0; // 1-9 from the colour list, 0 to ask
+	int threads = 0; // 0 to ask
+	int sweepThreads = 0; // --sweep goes up to this many threads, 0 for a normal render
+	bool sweepPowers = false; // only the powers of two (and sweepThreads itself) rather than every count
+	int sweepReps = defaultSweepReps;
+	std::string sweepCsv; // empty for no CSV
+	std::string output; // where the picture goes, without the extension (empty for output/mandelbrot<time>)
+};
+
+// the colours on offer, 1-9 in the order they're listed
+const char* const colourNames[] = { "White", "Black", "Red", "Orange", "Yellow", "Green", "Blue", "Indigo", "Violet" };
+const int colourValues[] = {
+	0xFFFFFF, // white
+	0x0c0c0c, // black, not exactly black so it can stay visible
+	0xFF0000, // red
+	0xFFA500, // orange
+	0xFFFF00, // yellow
+	0x00FF00, // green
+	0x0000FF, // blue
+	0x4B0082, // indigo
+	0x8F00FF, // violet
+};
+const int colourCount = 9;
+
+// the colour for a number from the list, anything that isn't on it is white
+void pick_colour(int choice, int& colour, std::string& colourName) {
+	if (choice < 1 || choice > colourCount) {
+		choice = 1;
+	}
+	colour = colourValues[choice - 1];
+	colourName = colourNames[choice - 1];
+}
+
+// a colour by its number or its name (any case), false if it's neither
+bool parse_colour(const std::string& text, int& choice) {
+	for (int i = 0; i < colourCount; ++i) {
+		std::string name = colourNames[i];
+		bool same = name.size() == text.size();
+		for (size_t c = 0; same && c < name.size(); ++c) {
+			same = std::tolower((unsigned char)name[c]) == std::tolower((unsigned char)text[c]);
+		}
+		if (same || text == std::to_string(i + 1)) {
+			choice = i + 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Reads the option at args[i], and any values it takes, into job and leaves i on the last thing it used
+// returns false if it isn't an option
+bool parse_option(const std::vector<std::string>& args, size_t& i, JobOptions& job) {
+	const std::string& arg = args[i];
+	if (arg == "--width" && i + 1 < args.size()) {
+		job.width = std::atoi(args[++i].c_str());
+	} else if (arg == "--height" && i + 1 < args.size()) {
+		job.height = std::atoi(args[++i].c_str());
+	} else if (arg == "--max-it" && i + 1 < args.size()) {
+		job.maxIt = std::max(1, std::atoi(args[++i].c_str()));
+	} else if (arg == "--no-cull") {
+		// iterate the cardioid and bulb too, to see what skipping them saves
+		job.cullInterior = false;
+	} else if (arg == "--period-tol" && i + 1 < args.size()) {
+		// 0 turns the cycle check off
+		job.periodTolerance = std::max(0.0, std::atof(args[++i].c_str()));
+	} else if (arg == "--subdivide") {
+		// only compute the pixels along the edges of ever smaller rectangles, filling in the one-colour ones
+		job.subdivideTiles = true;
+	} else if (arg == "--centre" && i + 2 < args.size()) {
+		// kept as text so a deep zoom can have more digits than a double holds
+		job.centreRe = args[++i];
+		job.centreIm = args[++i];
+	} else if (arg == "--radius" && i + 1 < args.size()) {
+		// half the height of the view
+		job.radius = args[++i];
+	} else if (arg == "--power" && i + 1 < args.size()) {
+		// z^power + c, the Multibrot sets
+		job.power = std::atoi(args[++i].c_str());
+	} else if (arg == "--julia" && i + 2 < args.size()) {
+		// the Julia set for this c instead
+		job.julia = true;
+		job.juliaRe = std::atof(args[++i].c_str());
+		job.juliaIm = std::atof(args[++i].c_str());
+	} else if (arg == "--deep") {
+		// use perturbation even if doubles would do
+		job.forceDeep = true;
+	} else if (arg == "--precision" && i + 1 < args.size()) {
+		// auto picks the cheapest type that can tell the pixels apart
+		const std::string text = args[++i];
+		if (text == "auto") {
+			job.autoPrecision = true;
+		} else if (parse_precision(text, job.precision)) {
+			job.autoPrecision = false;
+		} else {
+			std::cout << "Unknown precision " << text << ", working it out from the zoom" << std::endl;
+		}
+	} else if (arg == "--format" && i + 1 < args.size()) {
+		// tga, rle-tga or png
+		if (!parse_format(args[++i], job.format)) {
+			std::cout << "Unknown format " << args[i] << ", sticking with TGA" << std::endl;
+		}
+	} else if (arg == "--rle") {
+		job.format = OutputFormat::RLETGA;
+	} else if (arg == "--animate" && i + 4 < args.size()) {
+		// a zoom from the view the other options set up to centre RE IM with radius R, in FRAMES frames
+		job.animation.frames = std::max(1, std::atoi(args[++i].c_str()));
+		job.animation.endX = std::atof(args[++i].c_str());
+		job.animation.endY = std::atof(args[++i].c_str());
+		job.animation.endRadius = std::atof(args[++i].c_str());
+	} else if (arg == "--progressive") {
+		// coarse passes first, with a preview written after each one
+		job.progressive = true;
+	} else if (arg == "--banded") {
+		// stream the image out in bands instead of holding all of it in memory
+		job.banded = true;
+	} else if (arg == "--band-mb" && i + 1 < args.size()) {
+		job.banded = true;
+		job.bandBudget = size_t(std::max(1, std::atoi(args[++i].c_str()))) * 1024 * 1024;
+	} else if (arg == "--cache" && i + 1 < args.size()) {
+		// keep the iteration counts of every tile in this directory and reuse them when the same tile comes up again
+		job.cacheDir = args[++i];
+	} else if (arg == "--cache-mb" && i + 1 < args.size()) {
+		if (job.cacheDir.empty()) {
+			job.cacheDir = "cache";
+		}
+		job.cacheBudget = uint64_t(std::max(1, std::atoi(args[++i].c_str()))) * 1024 * 1024;
+	} else if (arg == "--serve" && i + 1 < args.size()) {
+		// stay up and serve map tiles of the view the other options set up to localhost on this port
+		job.servePort = std::atoi(args[++i].c_str());
+	} else if (arg == "--serve-queue" && i + 1 < args.size()) {
+		job.serveQueue = std::max(1, std::atoi(args[++i].c_str()));
+	} else if (arg == "--colour" && i + 1 < args.size()) {
+		// 1-9 or the name, so it doesn't have to be asked for
+		if (!parse_colour(args[++i], job.colourChoice)) {
+			std::cout << "Unknown colour " << args[i] << ", it'll be White" << std::endl;
+			job.colourChoice = 1;
+		}
+	} else if (arg == "--sweep" && i + 1 < args.size()) {
+		// time the render at 1 to N threads, or "pow2" for 1, 2, 4... up to the number of hardware threads
+		const std::string text = args[++i];
+		job.sweepPowers = text == "pow2";
+		job.sweepThreads = job.sweepPowers ? std::max(1, int(std::thread::hardware_concurrency()))
+		                                   : std::max(1, std::atoi(text.c_str()));
+	} else if (arg == "--sweep-reps" && i + 1 < args.size()) {
+		job.sweepReps = std::max(1, std::atoi(args[++i].c_str()));
+	} else if (arg == "--sweep-csv" && i + 1 < args.size()) {
+		job.sweepCsv = args[++i];
+	} else if (arg == "--threads" && i + 1 < args.size()) {
+		job.threads = std::max(1, std::atoi(args[++i].c_str()));
+	} else if (arg == "--output" && i + 1 < args.size()) {
+		// the extension gets added to it
+		job.output = args[++i];
+	} else if (arg == "--no-huge-pages") {
+		job.hugePages = false;
+	} else if (arg == "--strips") {
+		job.partition = Partition::Strips;
+	} else if (arg == "--columns") {
+		job.traversal = Traversal::Columns;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Renders one job, writing it to name plus the format's extension (or name_frame0000 and so on for an animation)
+// returns what main() should exit with
+int render_job(JobOptions job, const std::string& name, ThreadPool& pool) {
+	if (job.width <= 0 || job.height <= 0) {
+		std::cout << "Width and height have to be at least 1" << std::endl;
+		return 1;
+	}
+
+	if (!format_supported(job.format)) {
+		std::cout << "This build can't write " << format_name(job.format) << " files (it needs zlib)" << std::endl;
+		return 1;
+	}
+	if (job.banded && job.format == OutputFormat::PNG) {
+		std::cout << "The banded mode can only write TGA (or PPM), not PNG" << std::endl;
+		return 1;
+	}
+
+	if (job.power < minPower || job.power > maxPower) {
+		std::cout << "The power has to be between " << minPower << " and " << maxPower << std::endl;
+		return 1;
+	}
+	if (job.progressive && (job.banded || job.subdivideTiles)) {
+		std::cout << "--progressive can't be used with --banded or --subdivide" << std::endl;
+		return 1;
+	}
+	if (job.animation.frames > 0 && (job.banded || job.progressive || job.subdivideTiles || job.forceDeep)) {
+		std::cout << "--animate can't be used with --banded, --progressive, --subdivide or --deep" << std::endl;
+		return 1;
+	}
+	if (job.animation.frames > 0 && !(job.animation.endRadius > 0)) {
+		std::cout << "The radius the animation zooms to has to be more than 0" << std::endl;
+		return 1;
+	}
+	if (!job.cacheDir.empty() && (job.progressive || job.subdivideTiles || job.animation.frames > 0)) {
+		// those don't go through compute(), they've all got their own ways of saving work
+		std::cout << "--cache can't be used with --progressive, --subdivide or --animate" << std::endl;
+		return 1;
+	}
+	if (job.servePort != 0 && (job.banded || job.progressive || job.subdivideTiles || job.animation.frames > 0 || job.forceDeep)) {
+		std::cout << "--serve can't be used with --banded, --progressive, --subdivide, --animate or --deep" << std::endl;
+		return 1;
+	}
+	if (job.sweepThreads > 0 && (job.banded || job.progressive || job.animation.frames > 0 || job.servePort != 0 || !job.cacheDir.empty())) {
+		// a cache would turn every render after the first into reading the counts back
+		std::cout << "--sweep can't be used with --banded, --progressive, --animate, --serve or --cache" << std::endl;
+		return 1;
+	}
+	if (job.servePort < 0 || job.servePort > 65535) {
+		std::cout << "The port has to be between 1 and 65535" << std::endl;
+		return 1;
+	}
+	if (job.julia && job.subdivideTiles) {
+		// a Julia set can be in pieces, so a rectangle with a uniform border can still have some of it inside
+		std::cout << "--subdivide only works for the Mandelbrot set, not Julia sets" << std::endl;
+		return 1;
+	}
+
+	// a centre or radius replaces the default view with one that has square pixels
+	// (a Julia set is always centred on 0, so it gets a view of its own)
+	const bool customView = !job.centreRe.empty() || !job.radius.empty() || job.julia;
+	if (job.centreRe.empty()) {
+		job.centreRe = job.julia ? "0" : "-0.5";
+		job.centreIm = "0";
+	}
+	if (job.radius.empty()) {
+		job.radius = job.julia ? "1.5" : "1.125";
+	}
+	const double viewRadius = std::atof(job.radius.c_str());
+	if (!(viewRadius > 0) || 2 * viewRadius / job.height < minSpacing) {
+		std::cout << "The radius has to be more than 0 (and no smaller than " << minSpacing * job.height / 2 << ")" << std::endl;
+		return 1;
+	}
+
+	// the colour that the mandelbrot set will be made up of, and its name
+	int colour;
+	std::string colourName;
+	pick_colour(job.colourChoice, colour, colourName);
+
+	const int numIn = job.threads;
 
 	double left = -2; // X coord
 	double right = 1; // X coord
 	double top = 1.125; // Y coord
 	double bottom = -1.125; // Y coord
 
-	// <execution>
-	theClock::time_point start = theClock::now(); // start the clock
+	if (customView) {
+		const double spacing = 2 * viewRadius / job.height;
+		const double centreX = std::atof(job.centreRe.c_str());
+		const double centreY = std::atof(job.centreIm.c_str());
+		left = centreX - job.width / 2.0 * spacing;
+		right = centreX + job.width / 2.0 * spacing;
+		top = centreY + viewRadius;
+		bottom = centreY - viewRadius;
+	}
+
+	// the cheapest number type that can still tell neighbouring pixels apart, if even double-double can't
+	// then work out a reference orbit to iterate the pixels against instead
+	// (an animation has to manage its deepest frame too)
+	const double deepestRadius = job.animation.frames > 0 ? std::min(viewRadius, job.animation.endRadius) : viewRadius;
+	const double spacing = 2 * deepestRadius / job.height; // not top - bottom, which can round to nothing
+	double scale = std::max(std::max(std::fabs(left), std::fabs(right)), std::max(std::fabs(top), std::fabs(bottom)));
+	if (job.animation.frames > 0) {
+		scale = std::max(scale, std::max(std::fabs(job.animation.endX), std::fabs(job.animation.endY)) + job.animation.endRadius * job.width / job.height);
+	}
+	bool deep = job.forceDeep;
+	if (job.autoPrecision && !choose_precision(scale, spacing, job.precision)) {
+		deep = true;
+	}
+	if (job.animation.frames > 0 && (deep || !precision_has_row_kernel(job.precision))) {
+		std::cout << "The animation zooms in further than doubles can go, it needs a bigger radius to zoom to" << std::endl;
+		return 1;
+	}
+	if (job.servePort != 0 && deep) {
+		std::cout << "The map --serve starts from has to be shallow enough for doubles, it needs a bigger radius" << std::endl;
+		return 1;
+	}
+	if (deep && (job.power != 2 || job.julia)) {
+		std::cout << "Zooming in this far needs perturbation, which only does the z^2 Mandelbrot set" << std::endl;
+		return 1;
+	}
+
+	// the corner of the view to more than double precision, for the kernels that can use it
+	PreciseView precise = { left, 0.0, top, 0.0, (right - left) / job.width, (bottom - top) / job.height };
+	if (customView && !precision_has_row_kernel(job.precision)) {
+		const int bits = std::max(0, int(std::ceil(-std::log2(spacing)))) + 2 * precision_bits(job.precision);
+		if (!precise_corner(job.centreRe, job.centreIm, BigFixed::from_double(job.width / 2.0 * spacing, bits),
+		                    BigFixed::from_double(viewRadius, bits), bits, precise)) {
+			std::cout << "Couldn't read the centre " << job.centreRe << " " << job.centreIm << std::endl;
+			return 1;
+		}
+		precise.dx = spacing;
+		precise.dy = -spacing;
+	}
+
+	KernelOptions options = {};
+	options.cullInterior = job.cullInterior;
+	// on a deep zoom a tolerance that isn't well below the pixel spacing catches points near the edge that do escape
+	options.periodTolerance = std::min(job.periodTolerance, spacing * periodToleranceSpacing);
+	options.power = job.power;
+	options.fractal = job.julia ? Fractal::Julia : Fractal::Mandelbrot;
+	options.juliaRe = job.juliaRe;
+	options.juliaIm = job.juliaIm;
+
+	std::ostringstream fractalName;
+	fractalName << (job.julia ? "Julia set of " : "Mandelbrot set of ") << "z^" << job.power << " + c";
+	if (job.julia) {
+		fractalName << ", c = " << job.juliaRe << (job.juliaIm < 0 ? " - " : " + ") << std::fabs(job.juliaIm) << "i";
+	}
+	std::cout << "Drawing the " << fractalName.str() << std::endl;
+
+	// use the widest SIMD kernel this CPU can run, compiled for this fractal
+	const KernelType kernelType = best_kernel();
+	const EscapeRowFn kernel = kernel_function(kernelType, job.precision, options, job.maxIt);
+	const PreciseRowFn preciseKernel = (deep || precision_has_row_kernel(job.precision)) ? nullptr
+	                                   : precise_function(job.precision, options);
+	if (!deep) {
+		std::cout << "Using the " << (preciseKernel != nullptr ? "scalar" : kernel_name(kernelType)) << " kernel in "
+		          << precision_name(job.precision) << " (" << precision_bits(job.precision) << " bits)" << std::endl;
+	}
+
+	ReferenceOrbit orbit = {};
+	if (deep) {
+		if (!compute_reference(job.centreRe, job.centreIm, 2 * viewRadius / job.height, job.width, job.height, job.maxIt, orbit)) {
+			std::cout << "Couldn't read the centre " << job.centreRe << " " << job.centreIm << std::endl;
+			return 1;
+		}
+		std::cout << "Deep zoom: reference orbit worked out to " << orbit.precisionBits << " bits, "
+		          << orbit.zr.size() - 1 << " iterations long" << std::endl;
+	}
+
+	const bool culling = job.cullInterior && job.power == 2 && !job.julia;
+	std::cout << "Max iterations: " << job.maxIt << (culling ? " (skipping the cardioid and bulb)" : "") << std::endl;
+	if (job.periodTolerance > 0) {
+		std::cout << "Checking for cycles, tolerance " << options.periodTolerance << std::endl;
+	}
+	if (job.subdivideTiles) {
+		std::cout << "Subdividing tiles (Mariani-Silver)" << std::endl;
+	}
+
+	TileCache cache(job.cacheDir, job.cacheBudget);
+	if (!job.cacheDir.empty()) {
+		if (!cache.open()) {
+			std::cout << "Couldn't use " << job.cacheDir << " for the tile cache" << std::endl;
+			return 1;
+		}
+		std::cout << "Tile cache: " << job.cacheDir << " (" << cache.sizeBytes() / (1024 * 1024) << "MB of "
+		          << job.cacheBudget / (1024 * 1024) << "MB)" << std::endl;
+	}
+
+	RenderSettings settings = { { left, right, top, bottom, job.width, job.height }, kernel, preciseKernel, precise, options, job.traversal,
+	                           job.maxIt, colour, job.subdivideTiles, deep ? &orbit : nullptr, job.cacheDir.empty() ? nullptr : &cache, "" };
+	settings.cacheKey = cache_key(settings, job.precision);
+	if (deep) {
+		// the reference orbit only depends on these (and maxIt)
+		settings.cacheKey += " deep " + job.centreRe + " " + job.centreIm;
+	}
+
+	if (job.sweepThreads > 0) {
+		std::vector<int> threadCounts;
+		for (int threads = 1; threads <= job.sweepThreads; threads = job.sweepPowers ? threads * 2 : threads + 1) {
+			threadCounts.push_back(threads);
+		}
+		if (threadCounts.back() != job.sweepThreads) {
+			threadCounts.push_back(job.sweepThreads); // the hardware thread count isn't always a power of two
+		}
+		std::cout << "Resolution: " << job.width << "*" << job.height << std::endl;
+		std::cout << "Sweeping 1 to " << job.sweepThreads << " threads, median of " << job.sweepReps << " renders each" << std::endl;
+		return run_sweep(pool, settings, threadCounts, job.sweepReps, job.partition, job.hugePages, job.sweepCsv) ? 0 : 1;
+	}
 
 	int threadNum = numIn;
-	const int chunkSize = width / threadNum; // get the size of each "chunk" that's being calculated by each thread
 
-	auto* threads = new std::thread[threadNum]; // array of threads for computing
+	if (job.servePort != 0) {
+		// zoom 0 is a square as wide as the view the options set up at the default shape, so the default view
+		// has the whole set in the one tile
+		std::atomic<uint64_t> iterations(0);
+		const MapSettings map = { settings, job.centreRe, job.centreIm, viewRadius * defaultWidth / defaultHeight, kernelType,
+		                          job.autoPrecision, job.precision, job.periodTolerance, &iterations };
+		const OutputFormat tileFormat = format_supported(OutputFormat::PNG) ? OutputFormat::PNG : OutputFormat::TGA;
+		const ServerOptions serverOptions = { job.servePort, threadNum, serveConnections, job.serveQueue, maxMapZoom, tileFormat };
+
+		std::cout << "Serving " << colourName << " tiles on http://127.0.0.1:" << job.servePort << "/{z}/{x}/{y}"
+		          << format_extension(tileFormat) << " with " << threadNum << " render threads, Ctrl-C to stop" << std::endl;
+		ServerStats served = {};
+		const MapRenderFn render = [&map](const MapTile& tile, Framebuffer& image) { return render_map_tile(tile, image, map); };
+		if (!serve_tiles(serverOptions, render, served)) {
+			std::cout << "Couldn't serve on port " << job.servePort << std::endl;
+			return 1;
+		}
+
+		std::cout << "Served " << served.requests << " requests: " << served.rendered << " tiles rendered ("
+		          << (served.rendered > 0 ? served.renderSeconds * 1000 / served.rendered : 0.0) << "ms each), "
+		          << served.coalesced << " coalesced, " << served.rejected << " turned away busy, " << served.notFound
+		          << " not found, " << served.bytesSent << " bytes sent" << std::endl;
+		std::cout << "Iterations: " << iterations << std::endl;
+		if (settings.cache != nullptr) {
+			print_cache(cache);
+		}
+		return 0;
+	}
+
+	// (the server has threads of its own)
+	pool.reserve(threadNum + 1); // one over for the writer, so it doesn't hold up the computing
+	perf_reset(); // the job before in a batch
+
+	if (job.banded) {
+		std::cout << "Resolution: " << job.width << "*" << job.height << std::endl;
+		std::cout << "Generating a " << colourName << " Mandelbrot Set in bands, using " << numIn << " threads..." << std::endl;
+
+		// (change / to '\\' on windows)
+		std::string filename = name + (fits_tga(job.width, job.height) ? ".tga" : ".ppm");
+
+		theClock::time_point start = theClock::now();
+		size_t bytesWritten = 0;
+		std::vector<WorkerStats> workerStats(size_t(threadNum), WorkerStats {});
+		const theClock::duration encodeTime = render_banded(pool, filename, settings, threadNum, job.partition, job.bandBudget,
+		                                                    job.hugePages, job.format == OutputFormat::RLETGA, &bytesWritten, &workerStats);
+		write_time();
+		theClock::time_point end = theClock::now();
+
+		// the bands are written while the next one is computed, so the two times overlap
+		auto timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+		auto encodeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(encodeTime).count();
+		std::cout << "Time taken to generate: " << timeTaken << "ms (" << encodeTaken << "ms of it spent writing, overlapped)" << std::endl;
 
-	// populate the array
-	for (int i = 0; i < threadNum; ++i) {
-		threads[i] = std::thread(compute, left, right, top, bottom, (0 + chunkSize * i), chunkSize + chunkSize * i, colour);
+		KernelStats stats = {};
+		for (const WorkerStats& worker : workerStats) {
+			stats += worker.kernel;
+		}
+		print_workers(workerStats);
+		print_stats(stats, uint64_t(job.width) * job.height);
+		print_perf();
+		if (settings.cache != nullptr) {
+			print_cache(cache);
+		}
+
+		write_txt({ filename, job.width, job.height, 1, threadNum, int(timeTaken), int(timeTaken), int(encodeTaken), -1, colourName,
+		            fits_tga(job.width, job.height) ? format_name(job.format) : "PPM", bytesWritten, job.maxIt,
+		            fractalName.str(), stats, 0, "", cache.stats(), workerStats });
+		return 0;
 	}
-	std::thread timeWriteThread(write_time); // write the current time
 
-	std::unique_lock<std::mutex> lck(countLock);
-	while (runThreadsCount != threadNum) {
-		cv.wait(lck);
+	if (!fits_tga(job.width, job.height)) {
+		std::cout << "TGA files can't be bigger than 65535*65535, use --banded to write a PPM instead" << std::endl;
+		return 1;
 	}
 
-    // join the threads in the array
-	for (int i = 0; i < threadNum; ++i) {
-		threads[i].join();
+	if (job.animation.frames > 0) {
+		std::cout << "Resolution: " << job.width << "*" << job.height << std::endl;
+		std::cout << "Generating " << job.animation.frames << " frames of a " << colourName << " Mandelbrot Set zoom, using "
+		          << numIn << " threads..." << std::endl;
+
+		theClock::time_point start = theClock::now();
+		KernelStats stats = {};
+		uint64_t reused = 0;
+		size_t bytesWritten = 0;
+		const std::string reuseProblem = frame_reuse_problem(job.animation, viewRadius);
+		if (!reuseProblem.empty()) {
+			std::cout << "No pixels reused: " << reuseProblem << std::endl;
+		}
+		const theClock::duration encodeTime = render_animation(pool, settings, job.precision == Precision::Float,
+		                                                       std::atof(job.centreRe.c_str()), std::atof(job.centreIm.c_str()),
+		                                                       viewRadius, job.animation, threadNum, job.partition, job.hugePages,
+		                                                       job.format, name, &stats, &reused, &bytesWritten);
+		write_time();
+		theClock::time_point end = theClock::now();
+
+		// like the banded mode, each frame is written while the next one is computed so the times overlap
+		auto timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+		auto encodeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(encodeTime).count();
+		std::cout << "Time taken to generate: " << timeTaken << "ms (" << encodeTaken << "ms of it spent writing, overlapped), "
+		          << (timeTaken > 0 ? job.animation.frames * 1000.0 / timeTaken : 0.0) << " frames a second" << std::endl;
+
+		const uint64_t totalPixels = uint64_t(job.width) * job.height * job.animation.frames;
+		std::cout << "Pixels reused from the frame before: " << reused << " of " << totalPixels << std::endl;
+		print_stats(stats, totalPixels);
+		print_perf();
+
+		write_txt({ name + "_frame%04d" + format_extension(job.format), job.width, job.height, job.animation.frames, threadNum,
+		            int(timeTaken), int(timeTaken), int(encodeTaken), -1, colourName, format_name(job.format), bytesWritten,
+		            job.maxIt, fractalName.str(), stats, reused, reuseProblem, cache.stats(), {} });
+		return 0;
 	}
 
-	timeWriteThread.join(); // join the time thread
+	// the image lives on the heap now so its size can be picked at runtime
+	Framebuffer image(job.width, job.height, job.hugePages);
+	std::cout << "Resolution: " << job.width << "*" << job.height << (image.hugePages() ? " (huge pages)" : "") << std::endl;
 
-	std::cout << "Writing to TGA file" << std::endl;
+	std::cout << "Generating a " << colourName << " Mandelbrot Set, using " << numIn << " threads..." << std::endl;
+	std::string filename = name + format_extension(job.format);
 
-    auto timeNow = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()); // each file can have a unique filename
-    std::string filename = "output/mandelbrot" + std::to_string(timeNow) + ".tga"; // (change / to '\\' on windows)
+	// <execution>
+	theClock::time_point start = theClock::now(); // start the clock
+
+	KernelStats stats = {};
+	std::vector<WorkerStats> workerStats; // one each so they don't share (the progressive passes keep their own)
+	theClock::duration previewTime = -theClock::duration(std::chrono::milliseconds(1)); // (none)
+	if (job.progressive) {
+		previewTime = render_progressive(pool, image, settings, threadNum, job.partition, name, job.format, &stats);
+		write_time();
+		colour_rows(image, job.height, settings);
+	} else {
+		// split the image into small tiles, each thread gets its own deque of them and steals from the others when it runs out
+		TileScheduler scheduler(threadNum, job.width, job.height, tileSize, job.partition, Framebuffer::linePixels);
 
-	write_tga(filename);
+		TaskGroup workers(pool); // the computing, handed to the pool's threads
+		workerStats.assign(size_t(threadNum), WorkerStats {});
+
+		{
+			TraceScope scope("start workers");
+			for (int i = 0; i < threadNum; ++i) {
+				workers.run(std::bind(render_worker, &scheduler, &image, 0, i, &settings, &workerStats[size_t(i)]));
+			}
+			workers.run(write_time); // write the current time, on the spare thread
+		}
+		{
+			TraceScope scope("wait for workers");
+			workers.wait();
+		}
+
+		for (const WorkerStats& worker : workerStats) {
+			stats += worker.kernel;
+		}
+		if (settings.subdivide) {
+			colour_rows(image, job.height, settings);
+		}
+	}
+
+	std::cout << "Writing to " << format_name(job.format) << " file" << std::endl;
+
+	theClock::time_point computed = theClock::now(); // encoding gets timed on its own
+
+	// rows get packed (or compressed) on every thread
+	size_t bytesWritten = 0;
+	{
+		TraceScope scope("write_image");
+		if (!write_image(filename, image, job.format, threadNum, &bytesWritten, &pool)) {
+			std::cout << "Error writing to " << filename << std::endl;
+			return 1;
+		}
+	}
 
 	theClock::time_point end = theClock::now(); // stop the clock
 	// </execution>
 
 	auto timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+	auto computeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(computed - start).count();
+	auto encodeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(end - computed).count();
+	auto previewTaken = std::chrono::duration_cast<std::chrono::milliseconds>(previewTime).count();
 	std::cout << "Time taken to generate: " << timeTaken << "ms" << std::endl;
+	std::cout << "Compute: " << computeTaken << "ms, Encode: " << encodeTaken << "ms (" << bytesWritten << " bytes)" << std::endl;
 
-	write_txt(filename, threadNum, int(timeTaken), colourName);
+	if (!workerStats.empty()) {
+		print_workers(workerStats);
+	}
+	print_stats(stats, uint64_t(job.width) * job.height);
+	print_perf();
+	if (settings.cache != nullptr) {
+		print_cache(cache);
+	}
+
+	write_txt({ filename, job.width, job.height, 1, threadNum, int(timeTaken), int(computeTaken), int(encodeTaken), int(previewTaken),
+	            colourName, format_name(job.format), bytesWritten, job.maxIt, fractalName.str(), stats, 0, "", cache.stats(), workerStats });
 
 	return 0;
 }
+
+// asks for the colour and the thread count if the command line didn't give them (the answers can be piped in too),
+// false if stdin ran out or had something other than a number on it
+bool ask_missing(JobOptions& job) {
+	if (job.colourChoice == 0) {
+		std::cout << "Colours:";
+		for (int i = 0; i < colourCount; ++i) {
+			std::cout << " \n " << i + 1 << ": " << colourNames[i];
+		}
+		std::cout << std::endl;
+
+		std::cout << "Please choose a colour (1-9): " << std::endl;
+
+		// anything that isn't on the list gets white
+		if (!(std::cin >> job.colourChoice)) {
+			std::cout << "No colour given, pass --colour instead" << std::endl;
+			return false;
+		}
+	}
+
+	if (job.threads == 0) {
+		std::cout << "How many threads would you like to use?:" << std::endl;
+
+		while (true) {
+			if (!(std::cin >> job.threads)) {
+				std::cout << "No thread count given, pass --threads instead" << std::endl;
+				return false;
+			}
+			if (job.threads <= 0) {
+				std::cout << job.threads << " Is not a valid input" << std::endl;
+			} else {
+				break;
+			}
+		}
+	}
+	return true;
+}
+
+// where a job's picture goes, without the extension (--output with the format's extension on the end works too)
+std::string output_name(const JobOptions& job, const std::string& fallback) {
+	if (job.output.empty()) {
+		return fallback;
+	}
+	const std::string extension = format_extension(job.format);
+	const std::string& output = job.output;
+	if (output.size() > extension.size() && output.compare(output.size() - extension.size(), extension.size(), extension) == 0) {
+		return output.substr(0, output.size() - extension.size());
+	}
+	return output;
+}
+
+// Reads a --jobs file into jobs, each one starting from defaults. The file's an INI file: every [section] is a render
+// and every "key = value" line in it is the option --key with the value as its arguments (split on spaces, true on its
+// own for a flag, false leaves it out). Lines before the first section change the defaults for all the jobs after them.
+// Lines starting with ; or # are comments. Returns false, having said what's wrong, if the file isn't right.
+bool read_jobs(const std::string& file, JobOptions defaults, std::vector<std::pair<std::string, JobOptions>>& jobs) {
+	std::ifstream infile(file);
+	if (!infile) {
+		std::cout << "Couldn't open the job file " << file << std::endl;
+		return false;
+	}
+
+	std::string line;
+	for (int number = 1; std::getline(infile, line); ++number) {
+		// trim it, then skip the blanks and comments
+		const size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == ';' || line[first] == '#') {
+			continue;
+		}
+		line = line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+
+		if (line[0] == '[') {
+			if (line.back() != ']' || line.size() < 3) {
+				std::cout << file << ":" << number << ": a job's name goes between [ and ]" << std::endl;
+				return false;
+			}
+			jobs.push_back({ line.substr(1, line.size() - 2), defaults });
+			continue;
+		}
+
+		const size_t equals = line.find('=');
+		std::string key = line.substr(0, equals);
+		key = key.substr(0, key.find_last_not_of(" \t") + 1);
+		std::istringstream values(equals == std::string::npos ? "" : line.substr(equals + 1));
+		std::vector<std::string> args = { "--" + key };
+		std::string value;
+		while (values >> value) {
+			args.push_back(value);
+		}
+		if (args.size() == 2 && (args[1] == "true" || args[1] == "false")) {
+			if (args[1] == "false") {
+				continue;
+			}
+			args.pop_back();
+		}
+
+		JobOptions& job = jobs.empty() ? defaults : jobs.back().second;
+		size_t i = 0;
+		if (key == "jobs" || key == "serve" || !parse_option(args, i, job) || i + 1 != args.size()) {
+			std::cout << file << ":" << number << ": can't use " << line << std::endl;
+			return false;
+		}
+	}
+
+	if (jobs.empty()) {
+		std::cout << "There aren't any jobs in " << file << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// runs every job in a --jobs file one after another, without asking anything, and says how many of them failed
+int run_batch(const std::string& file, const JobOptions& defaults, time_t timeNow, ThreadPool& pool) {
+	std::vector<std::pair<std::string, JobOptions>> jobs;
+	if (!read_jobs(file, defaults, jobs)) {
+		return 1;
+	}
+
+	theClock::time_point start = theClock::now();
+	int failed = 0;
+	for (size_t j = 0; j < jobs.size(); ++j) {
+		JobOptions& job = jobs[j].second;
+		std::cout << "Job " << j + 1 << "/" << jobs.size() << ": " << jobs[j].first << std::endl;
+
+		// nobody's there to ask
+		if (job.colourChoice == 0) {
+			job.colourChoice = 1;
+		}
+		if (job.threads == 0) {
+			job.threads = std::max(1, int(std::thread::hardware_concurrency()));
+		}
+
+		// (change / to '\\' on windows)
+		const std::string name = output_name(job, "output/mandelbrot" + std::to_string(timeNow) + "_" + jobs[j].first);
+		if (render_job(job, name, pool) != 0) {
+			std::cout << "Job " << jobs[j].first << " failed" << std::endl;
+			++failed;
+		}
+	}
+
+	auto timeTaken = std::chrono::duration_cast<std::chrono::milliseconds>(theClock::now() - start).count();
+	std::cout << "Batch done: " << jobs.size() << " jobs, " << failed << " failed, " << timeTaken << "ms ("
+	          << double(timeTaken) / jobs.size() << "ms a job)" << std::endl;
+	return failed > 0 ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+	std::cout << "CMP 202 Mandelbrot Set Generator - 2021 Isaac Basque-Rice" << std::endl;
+
+	const std::vector<std::string> args(argv + 1, argv + argc);
+	JobOptions job;
+	std::string jobsFile;
+	std::string traceFile;
+	bool usePerf = false;
+	for (size_t i = 0; i < args.size(); ++i) {
+		if (args[i] == "--jobs" && i + 1 < args.size()) {
+			// a file of renders to do, the rest of the command line is the defaults for all of them
+			jobsFile = args[++i];
+		} else if (args[i] == "--perf") {
+			// hardware counters (IPC, cache and branch misses, FP instructions) for the compute and the encode
+			usePerf = true;
+		} else if (args[i] == "--trace" && i + 1 < args.size()) {
+			// a timeline of every thread for chrome://tracing or Perfetto, covering every job
+			traceFile = args[++i];
+		} else if (!parse_option(args, i, job)) {
+			// like a bad key in a job file, better to stop than render something that wasn't asked for
+			std::cout << "Unknown option " << args[i] << std::endl;
+			return 1;
+		}
+	}
+
+	auto timeNow = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now()); // each file can have a unique filename
+
+	std::string why;
+	if (usePerf && !perf_start(why)) {
+		std::cout << "Can't use the hardware counters, " << why << std::endl; // carry on without them
+	}
+
+	// the threads every render (and every job in a batch) shares, render_job starts as many as it needs
+	ThreadPool pool;
+
+	int result = 0;
+	if (!jobsFile.empty()) {
+		if (!traceFile.empty()) {
+			trace_start();
+		}
+		result = run_batch(jobsFile, job, timeNow, pool);
+	} else {
+		if (job.sweepThreads > 0) {
+			// the sweep picks its own thread counts and doesn't write a picture, so there's nothing to ask
+			job.colourChoice = std::max(job.colourChoice, 1);
+			job.threads = std::max(job.threads, 1);
+		}
+		if (!ask_missing(job)) {
+			return 1;
+		}
+		if (!traceFile.empty()) {
+			trace_start(); // not before now, or the trace starts with however long the questions took
+		}
+		// (change / to '\\' on windows)
+		result = render_job(job, output_name(job, "output/mandelbrot" + std::to_string(timeNow)), pool);
+	}
+
+	if (!traceFile.empty()) {
+		if (trace_write(traceFile)) {
+			std::cout << "Trace written to " << traceFile << std::endl;
+		} else {
+			std::cout << "Error writing to " << traceFile << std::endl;
+			result = 1;
+		}
+	}
+	return result;
+}
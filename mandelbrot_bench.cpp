@@ -0,0 +1,277 @@
+// Render benchmark
+// Renders a few fixed scenes with every kernel this CPU supports at 1, 2, 4... threads, timing only the compute
+// (no file writing), and reports the median and spread of the times along with pixels and iterations a second.
+// The results also go to mandelbrot_bench.csv and mandelbrot_bench.json so two builds can be diffed, along with the
+// hardware counters (IPC, cache and branch misses, FP instructions) for each render where perf lets us have them.
+//
+// usage: mandelbrot_bench [width] [height] [max threads] [repetitions] [warmup runs]
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.h"
+#include "kernel.h"
+#include "perfcounters.h"
+#include "scheduler.h"
+#include "threadpool.h"
+
+typedef std::chrono::steady_clock theClock;
+
+const int tileSize = 64; // same as main.cpp
+const char* csvFile = "mandelbrot_bench.csv";
+const char* jsonFile = "mandelbrot_bench.json";
+
+// a view of the Mandelbrot set, radius is half the height like --radius
+struct Scene {
+	const char* name;
+	double centreX;
+	double centreY;
+	double radius;
+	int maxIt;
+};
+
+// picked to stress different things: the default picture, a spiral full of slow escapers, a view that's all
+// inside the set (but outside the cardioid and bulb, so only the cycle check helps) and one along the edge
+const Scene scenes[] = {
+	{ "full-view", -0.5, 0.0, 1.125, 500 },
+	{ "seahorse-valley", -0.743643887, 0.131825904, 0.01, 2000 },
+	{ "deep-interior", -0.1225, 0.7449, 0.01, 5000 },
+	{ "edge-heavy", -0.75, 0.1, 0.05, 2000 },
+};
+
+// one line of the results
+struct Result {
+	std::string scene;
+	std::string kernel;
+	int threads;
+	int maxIt;
+	double minMs;
+	double medianMs;
+	double p10Ms;
+	double p90Ms;
+	double maxMs;
+	uint64_t pixels; // per render
+	uint64_t iterations;
+	PerfCounts perf; // an average render's, all zeros without the counters
+};
+
+// everything a worker needs for one render
+struct Job {
+	EscapeRowFn kernel;
+	KernelOptions options;
+	double left;
+	double top;
+	double spacing;
+	int maxIt;
+};
+
+void bench_worker(TileScheduler* scheduler, Framebuffer* image, int worker, const Job* job, KernelStats* stats) {
+	PerfScope counters(PerfPhase::Compute);
+	Tile tile = {};
+	KernelStats local = {};
+	while (scheduler->next(worker, tile)) {
+		for (int y = tile.y0; y < tile.y1; ++y) {
+			job->kernel(job->left, job->spacing, tile.x0, 1, job->top - y * job->spacing, tile.x1 - tile.x0, job->maxIt,
+			            job->options, local, image->row(y) + tile.x0);
+		}
+	}
+	*stats = local;
+}
+
+// renders the whole image once and returns how long it took, the kernel totals go in stats
+double render(ThreadPool& pool, Framebuffer& image, const Job& job, int threads, KernelStats& stats) {
+	TileScheduler scheduler(threads, image.width(), image.height(), tileSize, Partition::Tiles, Framebuffer::linePixels);
+	std::vector<KernelStats> threadStats(size_t(threads), KernelStats {});
+
+	theClock::time_point start = theClock::now();
+	TaskGroup workers(pool);
+	for (int i = 0; i < threads; ++i) {
+		workers.run(std::bind(bench_worker, &scheduler, &image, i, &job, &threadStats[size_t(i)]));
+	}
+	workers.wait();
+	theClock::time_point end = theClock::now();
+
+	stats = {};
+	for (const KernelStats& threadStat : threadStats) {
+		stats += threadStat;
+	}
+	return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// nearest rank percentile of a sorted list
+double percentile(const std::vector<double>& sorted, double percent) {
+	const size_t rank = size_t(std::max(1.0, std::ceil(percent / 100.0 * sorted.size())));
+	return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+double median(const std::vector<double>& sorted) {
+	const size_t mid = sorted.size() / 2;
+	return sorted.size() % 2 == 1 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+// instructions per cycle, or -1 if either counter isn't there
+double ipc(const PerfCounts& perf) {
+	if (!perf_available(PerfCounter::Cycles) || !perf_available(PerfCounter::Instructions) || perf[PerfCounter::Cycles] == 0) {
+		return -1;
+	}
+	return double(perf[PerfCounter::Instructions]) / perf[PerfCounter::Cycles];
+}
+
+// the counters go in as columns named after them, left empty (or null in the JSON) when they're not available
+std::string counter_column(PerfCounter counter) {
+	std::string name = perf_counter_name(counter);
+	std::replace(name.begin(), name.end(), ' ', '_');
+	std::transform(name.begin(), name.end(), name.begin(), [](char c) { return char(std::tolower((unsigned char)c)); });
+	return name;
+}
+
+void write_csv(const std::vector<Result>& results, int width, int height) {
+	std::ofstream out(csvFile);
+	out << "scene,kernel,threads,width,height,max_it,min_ms,median_ms,p10_ms,p90_ms,max_ms,pixels,iterations,"
+	       "mpixels_per_s,giga_iterations_per_s,ipc";
+	for (int i = 0; i < perfCounterCount; ++i) {
+		out << "," << counter_column(PerfCounter(i));
+	}
+	out << "\n";
+	for (const Result& r : results) {
+		out << r.scene << "," << r.kernel << "," << r.threads << "," << width << "," << height << "," << r.maxIt << ","
+		    << r.minMs << "," << r.medianMs << "," << r.p10Ms << "," << r.p90Ms << "," << r.maxMs << ","
+		    << r.pixels << "," << r.iterations << "," << r.pixels / (r.medianMs * 1000) << ","
+		    << r.iterations / (r.medianMs * 1e6) << ",";
+		if (ipc(r.perf) >= 0) {
+			out << ipc(r.perf);
+		}
+		for (int i = 0; i < perfCounterCount; ++i) {
+			out << ",";
+			if (perf_available(PerfCounter(i))) {
+				out << r.perf.value[i];
+			}
+		}
+		out << "\n";
+	}
+}
+
+void write_json(const std::vector<Result>& results, int width, int height, int reps, int warmup) {
+	std::ofstream out(jsonFile);
+	out << "{\n  \"width\": " << width << ",\n  \"height\": " << height << ",\n  \"repetitions\": " << reps
+	    << ",\n  \"warmup\": " << warmup << ",\n  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const Result& r = results[i];
+		out << "    { \"scene\": \"" << r.scene << "\", \"kernel\": \"" << r.kernel << "\", \"threads\": " << r.threads
+		    << ", \"max_it\": " << r.maxIt << ", \"min_ms\": " << r.minMs << ", \"median_ms\": " << r.medianMs
+		    << ", \"p10_ms\": " << r.p10Ms << ", \"p90_ms\": " << r.p90Ms << ", \"max_ms\": " << r.maxMs
+		    << ", \"pixels\": " << r.pixels << ", \"iterations\": " << r.iterations
+		    << ", \"mpixels_per_s\": " << r.pixels / (r.medianMs * 1000)
+		    << ", \"giga_iterations_per_s\": " << r.iterations / (r.medianMs * 1e6) << ", \"ipc\": ";
+		if (ipc(r.perf) >= 0) {
+			out << ipc(r.perf);
+		} else {
+			out << "null";
+		}
+		for (int c = 0; c < perfCounterCount; ++c) {
+			out << ", \"" << counter_column(PerfCounter(c)) << "\": ";
+			if (perf_available(PerfCounter(c))) {
+				out << r.perf.value[c];
+			} else {
+				out << "null";
+			}
+		}
+		out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+	const int width = argc > 1 ? std::atoi(argv[1]) : 1280;
+	const int height = argc > 2 ? std::atoi(argv[2]) : 960;
+	const int maxThreads = argc > 3 ? std::atoi(argv[3]) : std::max(1, int(std::thread::hardware_concurrency()));
+	const int reps = argc > 4 ? std::atoi(argv[4]) : 9;
+	const int warmup = argc > 5 ? std::atoi(argv[5]) : 2;
+
+	if (width <= 0 || height <= 0 || maxThreads <= 0 || reps <= 0 || warmup < 0) {
+		std::cout << "usage: mandelbrot_bench [width] [height] [max threads] [repetitions] [warmup runs]" << std::endl;
+		return 1;
+	}
+
+	// 1, 2, 4... and the maximum itself if it isn't a power of two
+	std::vector<int> threadCounts;
+	for (int threads = 1; threads < maxThreads; threads *= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+
+	std::string why;
+	if (!perf_start(why)) {
+		std::cout << "No hardware counters, " << why << std::endl;
+	}
+
+	ThreadPool pool(maxThreads);
+	Framebuffer image(width, height);
+
+	std::cout << "Rendering " << width << "*" << height << ", " << warmup << " warmup runs then " << reps << " timed" << std::endl;
+	std::cout << std::left << std::setw(18) << "scene" << std::setw(8) << "kernel" << std::right << std::setw(8) << "threads"
+	          << std::setw(12) << "median ms" << std::setw(10) << "p10 ms" << std::setw(10) << "p90 ms"
+	          << std::setw(12) << "Mpixels/s" << std::setw(10) << "Git/s" << std::setw(8) << "IPC" << std::endl;
+
+	const KernelType kernelTypes[] = { KernelType::Scalar, KernelType::AVX2, KernelType::AVX512 };
+	std::vector<Result> results;
+	for (const Scene& scene : scenes) {
+		const KernelOptions options = { true, 1e-12, 2, Fractal::Mandelbrot, 0.0, 0.0 };
+		const double spacing = 2 * scene.radius / height;
+		for (KernelType type : kernelTypes) {
+			if (!kernel_supported(type)) {
+				continue;
+			}
+			const Job job = { kernel_function(type, Precision::Double, options, scene.maxIt), options,
+			                  scene.centreX - width / 2.0 * spacing, scene.centreY + scene.radius, spacing, scene.maxIt };
+
+			for (int threads : threadCounts) {
+				KernelStats stats = {};
+				for (int run = 0; run < warmup; ++run) {
+					render(pool, image, job, threads, stats);
+				}
+				std::vector<double> times;
+				perf_reset(); // only the timed runs
+				for (int rep = 0; rep < reps; ++rep) {
+					times.push_back(render(pool, image, job, threads, stats));
+				}
+				std::sort(times.begin(), times.end());
+				PerfCounts perf = perf_totals(PerfPhase::Compute);
+				for (uint64_t& value : perf.value) {
+					value /= uint64_t(reps);
+				}
+
+				const Result result = { scene.name, kernel_name(type), threads, scene.maxIt, times.front(), median(times),
+				                        percentile(times, 10), percentile(times, 90), times.back(), stats.pixels, stats.iterations, perf };
+				results.push_back(result);
+
+				std::cout << std::left << std::setw(18) << result.scene << std::setw(8) << result.kernel << std::right
+				          << std::setw(8) << threads << std::fixed << std::setprecision(2) << std::setw(12) << result.medianMs
+				          << std::setw(10) << result.p10Ms << std::setw(10) << result.p90Ms
+				          << std::setw(12) << result.pixels / (result.medianMs * 1000)
+				          << std::setw(10) << result.iterations / (result.medianMs * 1e6) << std::setw(8);
+				if (ipc(perf) >= 0) {
+					std::cout << ipc(perf) << std::endl;
+				} else {
+					std::cout << "-" << std::endl;
+				}
+			}
+		}
+	}
+
+	write_csv(results, width, height);
+	write_json(results, width, height, reps, warmup);
+	std::cout << "Results written to " << csvFile << " and " << jsonFile << std::endl;
+	return 0;
+}
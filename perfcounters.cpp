@@ -0,0 +1,188 @@
+#include "perfcounters.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::atomic<bool> perf_detail::enabled(false);
+
+namespace {
+
+std::mutex totalsLock;
+PerfCounts totals[perfPhaseCount] = {};
+bool available[perfCounterCount] = {};
+
+#ifdef __linux__
+
+// FP_ARITH_INST_RETIRED with every umask bit set (scalar, 128, 256 and 512 bit, single and double), Skylake onwards
+const uint64_t intelFpArith = 0xFFC7;
+
+bool read_vendor_intel() {
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuinfo, line)) {
+		if (line.compare(0, 9, "vendor_id") == 0) {
+			return line.find("GenuineIntel") != std::string::npos;
+		}
+	}
+	return false;
+}
+
+bool genuine_intel() {
+	static const bool intel = read_vendor_intel();
+	return intel;
+}
+
+int open_counter(PerfCounter counter) {
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.exclude_kernel = 1; // what our code does, and it's all perf_event_paranoid 2 lets us have
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	switch (counter) {
+	case PerfCounter::Cycles: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+	case PerfCounter::Instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+	case PerfCounter::CacheMisses: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+	case PerfCounter::BranchMisses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+	case PerfCounter::FpOps:
+		if (!genuine_intel()) {
+			errno = ENOENT;
+			return -1;
+		}
+		attr.type = PERF_TYPE_RAW;
+		attr.config = intelFpArith;
+		break;
+	}
+	// this thread, on whichever CPU it's on
+	return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+// a thread's counters, opened the first time it uses a PerfScope and closed when it exits
+struct ThreadCounters {
+	int fds[perfCounterCount];
+
+	ThreadCounters() {
+		for (int i = 0; i < perfCounterCount; ++i) {
+			fds[i] = open_counter(PerfCounter(i));
+		}
+	}
+
+	~ThreadCounters() {
+		for (int fd : fds) {
+			if (fd >= 0) {
+				close(fd);
+			}
+		}
+	}
+
+	// the counts so far, scaled up for any time the kernel had the counter switched out to share the hardware
+	PerfCounts read_all() const {
+		PerfCounts counts = {};
+		for (int i = 0; i < perfCounterCount; ++i) {
+			uint64_t values[3] = {}; // value, time enabled, time running
+			if (fds[i] < 0 || ::read(fds[i], values, sizeof(values)) != ssize_t(sizeof(values))) {
+				continue;
+			}
+			counts.value[i] = (values[2] > 0 && values[2] < values[1]) ? uint64_t(double(values[0]) * values[1] / values[2]) : values[0];
+		}
+		return counts;
+	}
+};
+
+ThreadCounters& thread_counters() {
+	thread_local ThreadCounters counters;
+	return counters;
+}
+
+#endif
+
+}
+
+bool perf_start(std::string& why) {
+#ifdef __linux__
+	const ThreadCounters& counters = thread_counters();
+	bool any = false;
+	for (int i = 0; i < perfCounterCount; ++i) {
+		available[i] = counters.fds[i] >= 0;
+		any = any || available[i];
+	}
+	if (!any) {
+		// the cycle counter's the one every CPU has, so its error says the most
+		const int fd = open_counter(PerfCounter::Cycles);
+		why = std::string("perf_event_open: ") + std::strerror(errno);
+		if (fd >= 0) {
+			close(fd);
+		} else if (errno == EACCES || errno == EPERM) {
+			why += " (see /proc/sys/kernel/perf_event_paranoid)";
+		} else if (errno == ENOENT || errno == ENODEV || errno == EOPNOTSUPP) {
+			why += " (no hardware counters here, a VM or container often hides them)";
+		}
+		return false;
+	}
+	perf_detail::enabled.store(true);
+	return true;
+#else
+	why = "hardware counters are only supported on Linux";
+	return false;
+#endif
+}
+
+bool perf_available(PerfCounter counter) {
+	return available[int(counter)];
+}
+
+const char* perf_counter_name(PerfCounter counter) {
+	switch (counter) {
+	case PerfCounter::Cycles: return "cycles";
+	case PerfCounter::Instructions: return "instructions";
+	case PerfCounter::CacheMisses: return "cache misses";
+	case PerfCounter::BranchMisses: return "branch misses";
+	case PerfCounter::FpOps: return "FP instructions";
+	}
+	return "?";
+}
+
+PerfCounts perf_totals(PerfPhase phase) {
+	std::lock_guard<std::mutex> guard(totalsLock);
+	return totals[int(phase)];
+}
+
+void perf_reset() {
+	std::lock_guard<std::mutex> guard(totalsLock);
+	for (PerfCounts& phaseTotals : totals) {
+		phaseTotals = {};
+	}
+}
+
+PerfScope::PerfScope(PerfPhase phase) : phase(phase), counting(perf_enabled()), start() {
+#ifdef __linux__
+	if (counting) {
+		start = thread_counters().read_all();
+	}
+#endif
+}
+
+PerfScope::~PerfScope() {
+#ifdef __linux__
+	if (!counting) {
+		return;
+	}
+	const PerfCounts end = thread_counters().read_all();
+	PerfCounts used = {};
+	for (int i = 0; i < perfCounterCount; ++i) {
+		// (the scaling's an estimate, so a multiplexed counter can come out a touch lower than it was)
+		used.value[i] = end.value[i] > start.value[i] ? end.value[i] - start.value[i] : 0;
+	}
+	std::lock_guard<std::mutex> guard(totalsLock); // once per scope, and the scopes are a whole thread's share of a phase
+	totals[int(phase)] += used;
+#endif
+}
@@ -0,0 +1,80 @@
+// Hardware performance counters (Linux perf_event_open)
+// Every thread that runs a PerfScope opens its own set of counters the first time (user space only, so it works with
+// the default perf_event_paranoid of 2), and each scope adds what the counters went up by while it was open to the
+// totals for its phase. Counters the CPU or the kernel won't give us read as not available rather than failing, and
+// on other systems (or when perf isn't allowed at all) perf_start() says why and the scopes do nothing.
+
+#ifndef MANDELBROT_PERFCOUNTERS_H
+#define MANDELBROT_PERFCOUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class PerfCounter {
+	Cycles,
+	Instructions,
+	CacheMisses, // last level cache
+	BranchMisses,
+	FpOps, // floating point instructions retired (scalar and SIMD), Intel only as there's no generic event for it
+};
+const int perfCounterCount = 5;
+
+// what the counts are for
+enum class PerfPhase {
+	Compute, // the render threads
+	Encode, // writing the image
+};
+const int perfPhaseCount = 2;
+
+struct PerfCounts {
+	uint64_t value[perfCounterCount];
+
+	uint64_t operator[](PerfCounter counter) const { return value[int(counter)]; }
+
+	PerfCounts& operator+=(const PerfCounts& other) {
+		for (int i = 0; i < perfCounterCount; ++i) {
+			value[i] += other.value[i];
+		}
+		return *this;
+	}
+};
+
+namespace perf_detail {
+extern std::atomic<bool> enabled;
+}
+
+// Opens the counters on this thread to see which ones work and turns the scopes on.
+// Returns false, with the reason in why, if none of them do.
+bool perf_start(std::string& why);
+
+inline bool perf_enabled() {
+	return perf_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// whether perf_start() managed to open this counter
+bool perf_available(PerfCounter counter);
+
+// "cycles", "instructions" and so on
+const char* perf_counter_name(PerfCounter counter);
+
+// the totals every scope of a phase has added to since the last perf_reset()
+PerfCounts perf_totals(PerfPhase phase);
+void perf_reset();
+
+// counts what this thread does until it goes out of scope
+class PerfScope {
+public:
+	explicit PerfScope(PerfPhase phase);
+	~PerfScope();
+
+	PerfScope(const PerfScope&) = delete;
+	PerfScope& operator=(const PerfScope&) = delete;
+
+private:
+	PerfPhase phase;
+	bool counting;
+	PerfCounts start;
+};
+
+#endif //MANDELBROT_PERFCOUNTERS_H
@@ -0,0 +1,97 @@
+#include "perturb.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "bigfixed.h"
+
+const int guardBits = 64; // precision the reference gets on top of what it takes to tell neighbouring pixels apart
+
+bool compute_reference(const std::string& centreRe, const std::string& centreIm, double spacing, int width, int height,
+                       int maxIt, ReferenceOrbit& orbit) {
+	const int bits = std::max(0, int(std::ceil(-std::log2(spacing)))) + guardBits;
+
+	BigFixed cr;
+	BigFixed ci;
+	if (!BigFixed::parse(centreRe, bits, cr) || !BigFixed::parse(centreIm, bits, ci)) {
+		return false;
+	}
+
+	orbit.zr.assign(1, 0.0);
+	orbit.zi.assign(1, 0.0);
+	orbit.spacing = spacing;
+	orbit.width = width;
+	orbit.height = height;
+	orbit.precisionBits = cr.fractionBits();
+
+	// the plain escape loop, just with big numbers, and each step kept as doubles
+	BigFixed zr(bits);
+	BigFixed zi(bits);
+	for (int it = 0; it < maxIt; ++it) {
+		const BigFixed zr2 = zr * zr;
+		const BigFixed zi2 = zi * zi;
+		zi = (zr * zi).twice() + ci;
+		zr = zr2 - zi2 + cr;
+
+		const double r = zr.to_double();
+		const double i = zi.to_double();
+		orbit.zr.push_back(r);
+		orbit.zi.push_back(i);
+		if (r * r + i * i >= 4.0) {
+			break; // pixels that get this far get rebased
+		}
+	}
+	return true;
+}
+
+void perturb_row(const ReferenceOrbit& orbit, int x0, int step, int y, int count, int maxIt, KernelStats& stats,
+                 uint32_t* out) {
+	const int last = int(orbit.zr.size()) - 1;
+	const double* refR = orbit.zr.data();
+	const double* refI = orbit.zi.data();
+
+	// offset of the pixel's c from the centre's, same mapping as the plain render (top row is the top of the view)
+	const double dci = (orbit.height / 2.0 - y) * orbit.spacing;
+
+	for (int i = 0; i < count; ++i) {
+		const double dcr = (x0 + i * step - orbit.width / 2.0) * orbit.spacing;
+		++stats.pixels;
+
+		// z = Z_m + d, and z' = z^2 + c turns into d' = (2 Z_m + d) d + dc
+		double dr = 0.0;
+		double di = 0.0;
+		int m = 0;
+		int it = 0;
+		while (it < maxIt) {
+			const double tr = 2.0 * refR[m] + dr;
+			const double ti = 2.0 * refI[m] + di;
+			const double drTemp = tr * dr - ti * di + dcr;
+			di = tr * di + ti * dr + dci;
+			dr = drTemp;
+			++m;
+			++it;
+
+			const double zr = refR[m] + dr;
+			const double zi = refI[m] + di;
+			const double magnitude = zr * zr + zi * zi;
+			if (magnitude >= 4.0) {
+				break;
+			}
+
+			// the full value has got smaller than the offset (so the offset's lost its precision relative to it)
+			// or the reference has escaped and can't go any further: carry on from the start of the reference instead
+			if (magnitude < dr * dr + di * di || m == last) {
+				dr = zr;
+				di = zi;
+				m = 0;
+				++stats.rebases;
+			}
+		}
+
+		stats.iterations += uint64_t(it);
+		if (it < maxIt) {
+			++stats.escaped;
+		}
+		out[i] = uint32_t(it);
+	}
+}
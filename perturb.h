@@ -0,0 +1,36 @@
+// Deep zoom by perturbation
+// Past about 1e-27 the pixels are closer together than even a double-double can tell apart, so one reference orbit is
+// worked out in arbitrary precision at the centre of the view and every pixel is iterated as a small double-precision
+// offset from it. Whenever the offset's orbit gets bigger than the full value (which is where the precision it has left
+// runs out, the usual cause of glitches) or the reference runs out, the pixel is rebased: its full value becomes
+// the new offset from the start of the reference orbit and it carries on from there.
+
+#ifndef MANDELBROT_PERTURB_H
+#define MANDELBROT_PERTURB_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kernel.h"
+
+// the centre's orbit rounded to doubles, plus how the pixels map onto offsets from the centre
+struct ReferenceOrbit {
+	std::vector<double> zr; // Z_0 (always 0) up to where it escaped or maxIt
+	std::vector<double> zi;
+	double spacing; // distance between neighbouring pixels
+	int width; // size of the whole image, the centre is at pixel (width / 2, height / 2)
+	int height;
+	int precisionBits; // bits after the point the reference was worked out with
+};
+
+// works out the orbit of centreRe + centreIm i (decimal strings, so they can have as many digits as the zoom needs)
+// with enough precision for pixels spacing apart, returns false if the centre couldn't be parsed
+bool compute_reference(const std::string& centreRe, const std::string& centreIm, double spacing, int width, int height,
+                       int maxIt, ReferenceOrbit& orbit);
+
+// the deep zoom version of an EscapeRowFn: count pixels of row y (of the whole image), x0, x0 + step and so on
+void perturb_row(const ReferenceOrbit& orbit, int x0, int step, int y, int count, int maxIt, KernelStats& stats,
+                 uint32_t* out);
+
+#endif //MANDELBROT_PERTURB_H
@@ -0,0 +1,206 @@
+#include "png.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "encode.h"
+#include "perfcounters.h"
+#include "trace.h"
+
+const size_t blockTarget = 256 * 1024; // roughly how much raw data each block gets, same ballpark as pigz
+const size_t windowSize = 32 * 1024; // deflate can look back this far, so that's how much of the last block gets primed
+const size_t maxChunk = size_t(1) << 30; // keep IDAT chunks well under the 2^31 limit
+
+// one block of rows and what it compressed to
+struct PngBlock {
+	int y0;
+	int y1;
+	std::vector<uint8_t> compressed;
+	uLong adler;
+	size_t rawBytes;
+	bool ok;
+};
+
+static void put_u32(uint8_t* out, uint32_t value) {
+	out[0] = uint8_t(value >> 24);
+	out[1] = uint8_t(value >> 16);
+	out[2] = uint8_t(value >> 8);
+	out[3] = uint8_t(value);
+}
+
+// length, type, data, crc of type and data
+static void write_chunk(std::ostream& outfile, const char* type, const uint8_t* data, size_t size) {
+	uint8_t length[4];
+	put_u32(length, uint32_t(size));
+	outfile.write((const char*)length, 4);
+	outfile.write(type, 4);
+	if (size > 0) {
+		outfile.write((const char*)data, std::streamsize(size));
+	}
+
+	uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+	if (size > 0) {
+		crc = crc32(crc, data, uInt(size));
+	}
+	uint8_t crcBytes[4];
+	put_u32(crcBytes, uint32_t(crc));
+	outfile.write((const char*)crcBytes, 4);
+}
+
+// every row starts with its filter type (0, none), then the pixels as red/green/blue
+static void pack_png_rows(const Framebuffer& image, int y0, int y1, uint8_t* out) {
+	const int width = image.width();
+	const size_t rowBytes = size_t(width) * 3 + 1;
+	for (int y = y0; y < y1; ++y) {
+		out[0] = 0;
+		pack_pixels(image.row(y), width, out + 1, true);
+		out += rowBytes;
+	}
+}
+
+// deflates one block as a raw stream, ending on a byte boundary with a sync flush so the next block can follow it
+// (only the last block finishes the stream)
+static void compress_block(const Framebuffer& image, PngBlock& block, bool last) {
+	const size_t rowBytes = size_t(image.width()) * 3 + 1;
+
+	// the rows just before this block are packed in front of it to use as the dictionary
+	const int primeRows = std::min(block.y0, int((windowSize + rowBytes - 1) / rowBytes));
+	std::vector<uint8_t> raw(rowBytes * size_t(block.y1 - block.y0 + primeRows));
+	pack_png_rows(image, block.y0 - primeRows, block.y1, raw.data());
+
+	const size_t primeBytes = rowBytes * size_t(primeRows);
+	const uint8_t* data = raw.data() + primeBytes;
+	block.rawBytes = raw.size() - primeBytes;
+	block.adler = adler32(adler32(0L, Z_NULL, 0), data, uInt(block.rawBytes));
+
+	z_stream stream = {};
+	block.ok = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+	if (!block.ok) {
+		return;
+	}
+	if (primeRows > 0) {
+		const size_t dictionary = std::min(primeBytes, windowSize);
+		deflateSetDictionary(&stream, raw.data() + primeBytes - dictionary, uInt(dictionary));
+	}
+
+	// the bound doesn't count the sync flush marker, so leave a bit of room
+	block.compressed.resize(deflateBound(&stream, uLong(block.rawBytes)) + 64);
+	stream.next_in = const_cast<Bytef*>(data);
+	stream.avail_in = uInt(block.rawBytes);
+	stream.next_out = block.compressed.data();
+	stream.avail_out = uInt(block.compressed.size());
+
+	const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+	int result = deflate(&stream, flush);
+	while (result == Z_OK && (stream.avail_in > 0 || stream.avail_out == 0 || (last && result != Z_STREAM_END))) {
+		// ran out of room, give it some more
+		const size_t used = block.compressed.size() - stream.avail_out;
+		block.compressed.resize(block.compressed.size() * 2);
+		stream.next_out = block.compressed.data() + used;
+		stream.avail_out = uInt(block.compressed.size() - used);
+		result = deflate(&stream, flush);
+	}
+	block.ok = last ? result == Z_STREAM_END : (result == Z_OK || result == Z_BUF_ERROR) && stream.avail_in == 0;
+	block.compressed.resize(block.compressed.size() - stream.avail_out);
+	deflateEnd(&stream);
+}
+
+bool write_png(std::ostream& outfile, const Framebuffer& image, int threads, ThreadPool* pool) {
+	const int width = image.width();
+	const int height = image.height();
+	const size_t rowBytes = size_t(width) * 3 + 1;
+
+	// cut the rows up into blocks of about blockTarget bytes, at least one row each
+	const int blockRows = int(std::max<size_t>(1, blockTarget / rowBytes));
+	std::vector<PngBlock> blocks;
+	for (int y = 0; y < height; y += blockRows) {
+		blocks.push_back({ y, std::min(y + blockRows, height), {}, 0, 0, false });
+	}
+
+	// threads grab the next block until there aren't any left
+	std::atomic<int> nextBlock(0);
+	auto work = [&image, &blocks, &nextBlock]() {
+		PerfScope counters(PerfPhase::Encode);
+		for (int b = nextBlock++; b < int(blocks.size()); b = nextBlock++) {
+			TraceScope scope("compress block");
+			compress_block(image, blocks[size_t(b)], b == int(blocks.size()) - 1);
+		}
+	};
+	threads = std::max(1, std::min(threads, int(blocks.size())));
+	if (threads == 1) {
+		// a small image like a map tile isn't worth starting a thread for
+		work();
+	} else if (pool != nullptr) {
+		TaskGroup group(*pool);
+		for (int i = 0; i < threads; ++i) {
+			group.run(work);
+		}
+		group.wait();
+	} else {
+		std::vector<std::thread> workers;
+		for (int i = 0; i < threads; ++i) {
+			workers.emplace_back(work);
+		}
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	// the zlib checksum of the whole stream, stitched together from each block's
+	uLong adler = adler32(0L, Z_NULL, 0);
+	for (const PngBlock& block : blocks) {
+		if (!block.ok) {
+			return false;
+		}
+		adler = adler32_combine(adler, block.adler, z_off_t(block.rawBytes));
+	}
+
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	outfile.write((const char*)signature, 8);
+
+	uint8_t header[13];
+	put_u32(header, uint32_t(width));
+	put_u32(header + 4, uint32_t(height));
+	header[8] = 8; // bits per channel
+	header[9] = 2; // RGB
+	header[10] = 0; // deflate
+	header[11] = 0; // adaptive filtering (every row says which filter it used)
+	header[12] = 0; // not interlaced
+	write_chunk(outfile, "IHDR", header, sizeof(header));
+
+	// IDAT chunks just get concatenated back into one stream by the reader, so the zlib header goes in the
+	// first one, each block gets its own (split if it's huge) and the checksum goes in a last one
+	const uint8_t zlibHeader[2] = { 0x78, 0x9C };
+	write_chunk(outfile, "IDAT", zlibHeader, 2);
+	for (const PngBlock& block : blocks) {
+		for (size_t offset = 0; offset < block.compressed.size(); offset += maxChunk) {
+			const size_t size = std::min(maxChunk, block.compressed.size() - offset);
+			write_chunk(outfile, "IDAT", block.compressed.data() + offset, size);
+		}
+	}
+	uint8_t adlerBytes[4];
+	put_u32(adlerBytes, uint32_t(adler));
+	write_chunk(outfile, "IDAT", adlerBytes, 4);
+
+	write_chunk(outfile, "IEND", nullptr, 0);
+	return bool(outfile);
+}
+
+bool write_png(const std::string& name, const Framebuffer& image, int threads, size_t* bytesWritten, ThreadPool* pool) {
+	std::ofstream outfile(name, std::ofstream::binary);
+	if (!write_png(outfile, image, threads, pool)) {
+		return false;
+	}
+
+	if (bytesWritten != nullptr) {
+		*bytesWritten = size_t(outfile.tellp());
+	}
+	outfile.close();
+	return bool(outfile);
+}
@@ -0,0 +1,24 @@
+// PNG output
+// The rows are split into blocks that get deflated on separate threads (each one primed with the 32KB before it,
+// like pigz does) and the raw deflate streams are stitched together into one zlib stream across the IDAT chunks.
+// Only built when CMake finds zlib.
+
+#ifndef MANDELBROT_PNG_H
+#define MANDELBROT_PNG_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+#include "framebuffer.h"
+#include "threadpool.h"
+
+// writes the whole image as an 8-bit RGB PNG, bytesWritten (if given) gets the size of the file
+// the blocks are compressed as tasks on pool if it's given, returns false if anything went wrong
+bool write_png(const std::string& name, const Framebuffer& image, int threads, size_t* bytesWritten = nullptr,
+               ThreadPool* pool = nullptr);
+
+// the same into a stream (for a PNG that isn't going to a file)
+bool write_png(std::ostream& outfile, const Framebuffer& image, int threads, ThreadPool* pool = nullptr);
+
+#endif //MANDELBROT_PNG_H
@@ -0,0 +1,114 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+TileScheduler::TileScheduler(int workers, int width, int height, int tileSize, Partition partition, int alignPixels)
+		: totalTiles(0), outstanding(0), pushes(0) {
+	workers = std::max(workers, 1);
+	tileSize = std::max(tileSize, 1);
+	alignPixels = std::max(alignPixels, 1);
+
+	for (int i = 0; i < workers; ++i) {
+		queues.emplace_back(new WorkerQueue);
+	}
+
+	if (partition == Partition::Strips) {
+		// the old layout, kept around to compare against
+		// the last strip picks up whatever's left over so every column still gets rendered
+		const int chunkSize = width / workers;
+		for (int i = 0; i < workers; ++i) {
+			const int x1 = (i == workers - 1) ? width : chunkSize * (i + 1);
+			Tile tile = { chunkSize * i, 0, x1, height, 0 };
+			if (tile.x1 > tile.x0) {
+				queues[i]->tiles.push_back(tile);
+				++totalTiles;
+			}
+		}
+		outstanding = totalTiles;
+		return;
+	}
+
+	// round the width up to whole cache lines, the height doesn't matter since rows never share a line
+	const int tileWidth = (tileSize + alignPixels - 1) / alignPixels * alignPixels;
+
+	// dealing the tiles out round-robin means every worker gets a mix of cheap (outside the set)
+	// and expensive (inside the set) tiles to start with, so there's less stealing to do
+	int owner = 0;
+	for (int y = 0; y < height; y += tileSize) {
+		for (int x = 0; x < width; x += tileWidth) {
+			Tile tile = { x, y, std::min(x + tileWidth, width), std::min(y + tileSize, height), 0 };
+			queues[owner]->tiles.push_back(tile);
+			owner = (owner + 1) % workers;
+			++totalTiles;
+		}
+	}
+	outstanding = totalTiles;
+}
+
+bool TileScheduler::next(int worker, Tile& tile) {
+	WorkerQueue& own = *queues[worker];
+
+	// the last tile is done, anything it pushed has already been counted
+	if (own.holding) {
+		own.holding = false;
+		if (--outstanding == 0) {
+			std::lock_guard<std::mutex> guard(idleLock);
+			wake.notify_all();
+		}
+	}
+
+	while (true) {
+		const unsigned seen = pushes.load();
+		{
+			std::lock_guard<std::mutex> guard(own.lock);
+			if (!own.tiles.empty()) {
+				// take from the back of our own deque (LIFO keeps recently split tiles warm in cache)
+				tile = own.tiles.back();
+				own.tiles.pop_back();
+				own.holding = true;
+				return true;
+			}
+		}
+		if (steal(worker, tile)) {
+			own.holding = true;
+			return true;
+		}
+
+		// nothing to take, but someone still working might split their tile up, so sleep until they push
+		// something (since we looked) or the last of them is done
+		std::unique_lock<std::mutex> lock(idleLock);
+		wake.wait(lock, [&] { return pushes.load() != seen || outstanding.load() == 0; });
+		if (outstanding.load() == 0) {
+			return false;
+		}
+	}
+}
+
+void TileScheduler::push(int worker, const Tile& tile) {
+	WorkerQueue& own = *queues[worker];
+	++outstanding; // counted before it's visible so the total can't hit 0 while it's queued
+	{
+		std::lock_guard<std::mutex> guard(own.lock);
+		own.tiles.push_back(tile);
+	}
+	std::lock_guard<std::mutex> guard(idleLock);
+	++pushes;
+	wake.notify_one();
+}
+
+bool TileScheduler::steal(int thief, Tile& tile) {
+	const int workers = int(queues.size());
+
+	// try everyone else once, starting with our neighbour so thieves spread out
+	for (int i = 1; i < workers; ++i) {
+		WorkerQueue& victim = *queues[(thief + i) % workers];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.tiles.empty()) {
+			// steal from the front, the opposite end to the one the owner is working on
+			tile = victim.tiles.front();
+			victim.tiles.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,73 @@
+// Tile scheduler for the render threads
+// Each worker gets its own deque of tiles, pops from the back of its own deque and,
+// once that runs dry, steals from the front of someone else's.
+// Tiles can be pushed while the render is going (e.g. when one gets split up), so a worker only gives up
+// once nothing is queued and nobody is still working on a tile that might push more, and sleeps until
+// one of those happens rather than spinning over everyone's deques.
+
+#ifndef MANDELBROT_SCHEDULER_H
+#define MANDELBROT_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// a rectangle of pixels, x0/y0 inclusive and x1/y1 exclusive
+struct Tile {
+	int x0;
+	int y0;
+	int x1;
+	int y1;
+	int depth; // how many times it's been split, 0 for the tiles the scheduler started with
+};
+
+// how the image gets cut up between the workers
+enum class Partition {
+	Strips, // one column strip per worker like the original version (neighbouring strips share cache lines)
+	Tiles, // small tiles whose left/right edges sit on cache line boundaries
+};
+
+class TileScheduler {
+public:
+	// cuts a width*height image into tileSize*tileSize tiles (edge tiles are clipped)
+	// and deals them out round-robin between the workers
+	// with Partition::Tiles the tile width is rounded up to a multiple of alignPixels so no two tiles
+	// ever write into the same cache line of a row (as long as the rows themselves start on a cache line)
+	TileScheduler(int workers, int width, int height, int tileSize,
+	              Partition partition = Partition::Tiles, int alignPixels = 1);
+
+	// grabs the next tile for this worker, stealing if its own deque is empty
+	// calling it again means the worker has finished with the last tile it was given
+	// returns false once there's nothing left anywhere and no other worker can push any more
+	bool next(int worker, Tile& tile);
+
+	// adds a tile to a worker's deque (used when a tile gets split into more work),
+	// only call it from that worker while it's holding a tile
+	void push(int worker, const Tile& tile);
+
+	int workerCount() const { return int(queues.size()); }
+	int tileCount() const { return totalTiles; }
+
+private:
+	struct WorkerQueue {
+		std::mutex lock; // one lock per deque so workers only contend when stealing
+		std::deque<Tile> tiles;
+		bool holding = false; // only touched by the worker itself
+	};
+
+	bool steal(int thief, Tile& tile);
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	int totalTiles;
+	std::atomic<int> outstanding; // tiles queued plus tiles being worked on
+
+	// for workers with nothing to do, woken by a push or by the last tile finishing
+	std::mutex idleLock;
+	std::condition_variable wake;
+	std::atomic<unsigned> pushes; // bumped under idleLock so a sleeper can tell it missed one
+};
+
+#endif //MANDELBROT_SCHEDULER_H
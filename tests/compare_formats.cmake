@@ -0,0 +1,26 @@
+# Renders the same view in two formats and fails unless IMAGE_COMPARE decodes them to the same pixels.
+# cmake -DMANDELBROT=<binary> -DIMAGE_COMPARE=<binary> -DNAME=<output name> -DVIEW="<options>"
+#       -DFORMATS="<format> <format>" -P compare_formats.cmake
+
+separate_arguments(view UNIX_COMMAND "${VIEW}")
+separate_arguments(formats UNIX_COMMAND "${FORMATS}")
+
+set(files)
+foreach(format ${formats})
+    if(format STREQUAL "png")
+        set(extension png)
+    else()
+        set(extension tga)
+    endif()
+    execute_process(COMMAND ${MANDELBROT} --colour 1 --threads 4 ${view} --format ${format} --output ${NAME}_${format}
+                    RESULT_VARIABLE result OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${MANDELBROT} ${view} --format ${format} failed (${result})")
+    endif()
+    list(APPEND files ${NAME}_${format}.${extension})
+endforeach()
+
+execute_process(COMMAND ${IMAGE_COMPARE} ${files} RESULT_VARIABLE different)
+if(different)
+    message(FATAL_ERROR "${files} don't have the same pixels")
+endif()
@@ -0,0 +1,24 @@
+# Renders the same view twice, once as it is and once with EXTRA on the end of the options, and fails unless the two
+# files come out byte for byte the same.
+# cmake -DMANDELBROT=<binary> -DNAME=<output name> -DVIEW="<options>" -DEXTRA="<options>" -P compare_renders.cmake
+
+separate_arguments(view UNIX_COMMAND "${VIEW}")
+separate_arguments(extra UNIX_COMMAND "${EXTRA}")
+
+foreach(run plain extra)
+    if(run STREQUAL "plain")
+        set(options ${view})
+    else()
+        set(options ${view} ${extra})
+    endif()
+    execute_process(COMMAND ${MANDELBROT} --colour 1 --threads 4 ${options} --output ${NAME}_${run}
+                    RESULT_VARIABLE result OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${MANDELBROT} ${options} failed (${result})")
+    endif()
+endforeach()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${NAME}_plain.tga ${NAME}_extra.tga RESULT_VARIABLE different)
+if(different)
+    message(FATAL_ERROR "${NAME}_extra.tga isn't the same as ${NAME}_plain.tga")
+endif()
@@ -0,0 +1,213 @@
+// Decodes two pictures (24-bit TGA, raw or run-length encoded, or 8-bit RGB PNG) and checks they have the same
+// pixels, so the same render written in two formats can be compared whatever order each one stores its rows in.
+//
+// usage: image_compare a.tga b.png
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+// red, green, blue for every pixel, top row first
+struct Picture {
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> rgb;
+};
+
+bool read_file(const std::string& name, std::vector<uint8_t>& data) {
+	std::ifstream infile(name, std::ios::binary);
+	if (!infile) {
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+	return true;
+}
+
+bool ends_with(const std::string& text, const std::string& suffix) {
+	return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool decode_tga(const std::vector<uint8_t>& data, Picture& picture, std::string& why) {
+	if (data.size() < 18 || (data[2] != 2 && data[2] != 10) || data[16] != 24) {
+		why = "not a 24-bit TGA";
+		return false;
+	}
+	picture.width = data[12] | data[13] << 8;
+	picture.height = data[14] | data[15] << 8;
+	const bool topDown = (data[17] & 0x20) != 0; // otherwise the first row in the file is the bottom one
+	const size_t pixels = size_t(picture.width) * picture.height;
+
+	// the pixels in file order, still blue/green/red
+	std::vector<uint8_t> bgr;
+	bgr.reserve(pixels * 3);
+	size_t at = 18 + data[0]; // past the image ID
+	if (data[2] == 2) {
+		if (data.size() < at + pixels * 3) {
+			why = "the pixels are cut short";
+			return false;
+		}
+		bgr.assign(data.begin() + long(at), data.begin() + long(at + pixels * 3));
+	} else {
+		while (bgr.size() < pixels * 3) {
+			if (at >= data.size()) {
+				why = "the runs are cut short";
+				return false;
+			}
+			const uint8_t packet = data[at++];
+			const size_t count = (packet & 0x7F) + 1u;
+			const size_t bytes = (packet & 0x80) ? 3 : count * 3;
+			if (at + bytes > data.size()) {
+				why = "the runs are cut short";
+				return false;
+			}
+			for (size_t i = 0; i < count; ++i) {
+				const size_t from = (packet & 0x80) ? at : at + i * 3;
+				bgr.insert(bgr.end(), data.begin() + long(from), data.begin() + long(from + 3));
+			}
+			at += bytes;
+		}
+		bgr.resize(pixels * 3);
+	}
+
+	picture.rgb.resize(pixels * 3);
+	const size_t rowBytes = size_t(picture.width) * 3;
+	for (int y = 0; y < picture.height; ++y) {
+		const uint8_t* in = &bgr[size_t(topDown ? y : picture.height - 1 - y) * rowBytes];
+		uint8_t* out = &picture.rgb[size_t(y) * rowBytes];
+		for (size_t x = 0; x < rowBytes; x += 3) {
+			out[x] = in[x + 2];
+			out[x + 1] = in[x + 1];
+			out[x + 2] = in[x];
+		}
+	}
+	return true;
+}
+
+uint32_t get_u32(const uint8_t* bytes) {
+	return uint32_t(bytes[0]) << 24 | uint32_t(bytes[1]) << 16 | uint32_t(bytes[2]) << 8 | bytes[3];
+}
+
+int paeth(int a, int b, int c) {
+	const int p = a + b - c;
+	const int pa = p > a ? p - a : a - p;
+	const int pb = p > b ? p - b : b - p;
+	const int pc = p > c ? p - c : c - p;
+	return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+}
+
+bool decode_png(const std::vector<uint8_t>& data, Picture& picture, std::string& why) {
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	if (data.size() < 8 || std::memcmp(data.data(), signature, 8) != 0) {
+		why = "not a PNG";
+		return false;
+	}
+
+	std::vector<uint8_t> compressed;
+	for (size_t at = 8; at + 12 <= data.size();) {
+		const size_t length = get_u32(&data[at]);
+		const std::string type(data.begin() + long(at + 4), data.begin() + long(at + 8));
+		if (at + 12 + length > data.size()) {
+			why = "a chunk is cut short";
+			return false;
+		}
+		const uint8_t* body = &data[at + 8];
+		if (type == "IHDR") {
+			picture.width = int(get_u32(body));
+			picture.height = int(get_u32(body + 4));
+			if (body[8] != 8 || body[9] != 2 || body[12] != 0) {
+				why = "only 8-bit RGB without interlacing is supported";
+				return false;
+			}
+		} else if (type == "IDAT") {
+			compressed.insert(compressed.end(), body, body + length);
+		} else if (type == "IEND") {
+			break;
+		}
+		at += 12 + length;
+	}
+
+	const size_t rowBytes = size_t(picture.width) * 3;
+	std::vector<uint8_t> raw((rowBytes + 1) * size_t(picture.height));
+	uLongf rawSize = uLongf(raw.size());
+	if (uncompress(raw.data(), &rawSize, compressed.data(), uLong(compressed.size())) != Z_OK || rawSize != raw.size()) {
+		why = "the pixels don't inflate to the right size";
+		return false;
+	}
+
+	picture.rgb.resize(rowBytes * size_t(picture.height));
+	for (int y = 0; y < picture.height; ++y) {
+		const uint8_t filter = raw[size_t(y) * (rowBytes + 1)];
+		const uint8_t* in = &raw[size_t(y) * (rowBytes + 1) + 1];
+		uint8_t* out = &picture.rgb[size_t(y) * rowBytes];
+		const uint8_t* above = y > 0 ? out - rowBytes : nullptr;
+		for (size_t x = 0; x < rowBytes; ++x) {
+			const int a = x >= 3 ? out[x - 3] : 0;
+			const int b = above != nullptr ? above[x] : 0;
+			const int c = (x >= 3 && above != nullptr) ? above[x - 3] : 0;
+			int predicted = 0;
+			switch (filter) {
+			case 0: break;
+			case 1: predicted = a; break;
+			case 2: predicted = b; break;
+			case 3: predicted = (a + b) / 2; break;
+			case 4: predicted = paeth(a, b, c); break;
+			default:
+				why = "unknown filter " + std::to_string(filter);
+				return false;
+			}
+			out[x] = uint8_t(in[x] + predicted);
+		}
+	}
+	return true;
+}
+
+bool decode(const std::string& name, Picture& picture) {
+	std::vector<uint8_t> data;
+	if (!read_file(name, data)) {
+		std::cout << "Couldn't read " << name << std::endl;
+		return false;
+	}
+	std::string why;
+	const bool decoded = ends_with(name, ".png") ? decode_png(data, picture, why) : decode_tga(data, picture, why);
+	if (!decoded) {
+		std::cout << name << ": " << why << std::endl;
+	}
+	return decoded;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cout << "usage: image_compare a.tga b.png" << std::endl;
+		return 2;
+	}
+
+	Picture first;
+	Picture second;
+	if (!decode(argv[1], first) || !decode(argv[2], second)) {
+		return 2;
+	}
+	if (first.width != second.width || first.height != second.height) {
+		std::cout << argv[1] << " is " << first.width << "*" << first.height << " but " << argv[2] << " is "
+		          << second.width << "*" << second.height << std::endl;
+		return 1;
+	}
+
+	uint64_t different = 0;
+	for (size_t i = 0; i < first.rgb.size(); i += 3) {
+		if (std::memcmp(&first.rgb[i], &second.rgb[i], 3) != 0) {
+			++different;
+		}
+	}
+	if (different > 0) {
+		std::cout << different << " of " << uint64_t(first.width) * first.height << " pixels differ between " << argv[1]
+		          << " and " << argv[2] << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,116 @@
+#include "threadpool.h"
+
+#include <utility>
+
+ThreadPool::ThreadPool(int threads) : stopping(false) {
+	reserve(threads);
+}
+
+ThreadPool::~ThreadPool() {
+	shutdown();
+}
+
+void ThreadPool::reserve(int count) {
+	std::lock_guard<std::mutex> guard(lock);
+	if (stopping) {
+		return;
+	}
+	while (int(threads.size()) < count) {
+		threads.emplace_back(&ThreadPool::worker, this);
+	}
+}
+
+int ThreadPool::size() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return int(threads.size());
+}
+
+void ThreadPool::shutdown() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (stopping) {
+			return;
+		}
+		stopping = true;
+	}
+	ready.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::worker() {
+	while (true) {
+		std::unique_lock<std::mutex> guard(lock);
+		ready.wait(guard, [this]() { return stopping || !tasks.empty(); });
+		if (tasks.empty()) {
+			return; // stopping, and the queue's run dry
+		}
+		Task task = std::move(tasks.front());
+		tasks.pop_front();
+		guard.unlock();
+
+		task.work();
+		task.group->finished();
+	}
+}
+
+void ThreadPool::submit(TaskGroup* group, std::function<void()> work) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		// with nobody left to run it, the waiter will
+		if (!stopping && !threads.empty()) {
+			tasks.push_back({ group, std::move(work) });
+			ready.notify_one();
+			return;
+		}
+	}
+	work();
+	group->finished();
+}
+
+bool ThreadPool::run_queued(TaskGroup* group) {
+	std::unique_lock<std::mutex> guard(lock);
+	for (auto task = tasks.begin(); task != tasks.end(); ++task) {
+		if (task->group == group) {
+			Task mine = std::move(*task);
+			tasks.erase(task);
+			guard.unlock();
+
+			mine.work();
+			group->finished();
+			return true;
+		}
+	}
+	return false;
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool) : pool(pool), pending(0) {
+}
+
+TaskGroup::~TaskGroup() {
+	wait();
+}
+
+void TaskGroup::run(std::function<void()> work) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		++pending;
+	}
+	pool.submit(this, std::move(work));
+}
+
+void TaskGroup::wait() {
+	// lend a hand with whatever of ours nobody's started yet, then wait for the ones that have been
+	while (pool.run_queued(this)) {
+	}
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [this]() { return pending == 0; });
+}
+
+void TaskGroup::finished() {
+	std::lock_guard<std::mutex> guard(lock);
+	if (--pending == 0) {
+		done.notify_all();
+	}
+}
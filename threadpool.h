@@ -0,0 +1,78 @@
+// Persistent worker threads for everything that used to start its own
+// The render workers, the writers and the encoders hand their work to the pool as tasks in a TaskGroup and then wait
+// for the group, instead of starting and joining threads every time, which adds up once the renders are small and
+// there are lots of them (a batch of thumbnails, say). A group's wait() runs the group's own tasks that haven't been
+// picked up yet on the waiting thread, so a task can wait on a group of its own without tying the pool up.
+
+#ifndef MANDELBROT_THREADPOOL_H
+#define MANDELBROT_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+class ThreadPool {
+public:
+	explicit ThreadPool(int threads = 0);
+	~ThreadPool(); // same as shutdown()
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// starts more threads if there are fewer than this, they stay until shutdown
+	void reserve(int threads);
+	int size() const;
+
+	// finishes everything that's queued and joins the threads, anything submitted after runs on the caller
+	void shutdown();
+
+private:
+	friend class TaskGroup;
+
+	struct Task {
+		TaskGroup* group;
+		std::function<void()> work;
+	};
+
+	void worker();
+	void submit(TaskGroup* group, std::function<void()> work);
+	bool run_queued(TaskGroup* group); // runs one of group's tasks on this thread, false if none are queued
+
+	mutable std::mutex lock;
+	std::condition_variable ready;
+	std::deque<Task> tasks;
+	std::vector<std::thread> threads;
+	bool stopping;
+};
+
+// tasks that get waited for together
+class TaskGroup {
+public:
+	explicit TaskGroup(ThreadPool& pool);
+	~TaskGroup(); // waits for anything still going
+
+	TaskGroup(const TaskGroup&) = delete;
+	TaskGroup& operator=(const TaskGroup&) = delete;
+
+	void run(std::function<void()> work);
+
+	// returns once every task run() was given has finished
+	void wait();
+
+private:
+	friend class ThreadPool;
+
+	void finished();
+
+	ThreadPool& pool;
+	std::mutex lock;
+	std::condition_variable done;
+	int pending;
+};
+
+#endif //MANDELBROT_THREADPOOL_H
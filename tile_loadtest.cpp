@@ -0,0 +1,189 @@
+// Load test for the --serve tile server
+// Opens a number of kept-alive connections to the server on localhost and has each one ask for tiles as fast as it
+// gets them back, picking a zoom level at random and then a tile on it at random (so the low zooms get asked for a
+// lot, which is what the coalescing is for). Reports the p50/p90/p99 latency of the tiles that came back, requests
+// a second and how many got turned away as busy. The tiles picked are the same every run.
+//
+// usage: tile_loadtest [port] [connections] [requests] [max zoom]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock theClock;
+
+// what one connection saw
+struct ClientResult {
+	std::vector<double> latencies; // ms, tiles that came back 200 only
+	int ok;
+	int busy; // 503s
+	int failed; // anything else, or the connection went
+	uint64_t bytes;
+};
+
+static int connect_to(int port) {
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(uint16_t(port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// one request and its whole response, returns the status (0 if the connection broke) and whether it's still open
+static int fetch(int fd, const std::string& path, uint64_t& bytes, bool& keepOpen) {
+	const std::string request = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+	if (send(fd, request.data(), request.size(), 0) != ssize_t(request.size())) {
+		return 0;
+	}
+
+	std::string response;
+	size_t headerEnd = std::string::npos;
+	char chunk[16384];
+	while (headerEnd == std::string::npos) {
+		const ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+		if (got <= 0) {
+			return 0;
+		}
+		response.append(chunk, size_t(got));
+		headerEnd = response.find("\r\n\r\n");
+	}
+
+	int status = 0;
+	std::sscanf(response.c_str(), "HTTP/1.%*d %d", &status);
+	size_t length = 0;
+	const size_t lengthAt = response.find("Content-Length: ");
+	if (lengthAt != std::string::npos && lengthAt < headerEnd) {
+		length = size_t(std::strtoull(response.c_str() + lengthAt + 16, nullptr, 10));
+	}
+	keepOpen = response.find("Connection: close") == std::string::npos;
+
+	// the rest of the body
+	size_t have = response.size() - headerEnd - 4;
+	while (have < length) {
+		const ssize_t got = recv(fd, chunk, std::min(sizeof(chunk), length - have), 0);
+		if (got <= 0) {
+			return 0;
+		}
+		have += size_t(got);
+	}
+	bytes += length;
+	return status;
+}
+
+void client(int port, int index, int requests, int maxZoom, ClientResult* result) {
+	std::mt19937 random(uint32_t(index) + 1);
+	int fd = -1;
+	for (int r = 0; r < requests; ++r) {
+		const int z = std::uniform_int_distribution<int>(0, maxZoom)(random);
+		const int x = std::uniform_int_distribution<int>(0, (1 << z) - 1)(random);
+		const int y = std::uniform_int_distribution<int>(0, (1 << z) - 1)(random);
+		const std::string path = "/" + std::to_string(z) + "/" + std::to_string(x) + "/" + std::to_string(y);
+
+		if (fd < 0) {
+			fd = connect_to(port);
+		}
+		bool keepOpen = false;
+		const theClock::time_point start = theClock::now();
+		const int status = fd < 0 ? 0 : fetch(fd, path, result->bytes, keepOpen);
+		const std::chrono::duration<double, std::milli> taken = theClock::now() - start;
+
+		if (status == 200) {
+			++result->ok;
+			result->latencies.push_back(taken.count());
+		} else if (status == 503) {
+			++result->busy;
+		} else {
+			++result->failed;
+		}
+		if (status == 0 || !keepOpen) {
+			if (fd >= 0) {
+				close(fd);
+			}
+			fd = -1;
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+// nearest rank, sorted has to be sorted already
+double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	const size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+	return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+int main(int argc, char* argv[]) {
+	const int port = argc > 1 ? std::atoi(argv[1]) : 8080;
+	const int connections = argc > 2 ? std::max(1, std::atoi(argv[2])) : 16;
+	const int requests = argc > 3 ? std::max(1, std::atoi(argv[3])) : 2000;
+	const int maxZoom = argc > 4 ? std::min(30, std::max(0, std::atoi(argv[4]))) : 8;
+
+	std::signal(SIGPIPE, SIG_IGN); // the server closing a connection shows up as a failed send instead
+
+	std::cout << "Asking 127.0.0.1:" << port << " for " << requests << " tiles (zoom 0 to " << maxZoom << ") over "
+	          << connections << " connections" << std::endl;
+
+	// spread the requests over the connections, the first few take one more if it doesn't divide
+	std::vector<ClientResult> results(size_t(connections), ClientResult { {}, 0, 0, 0, 0 });
+	std::vector<std::thread> threads;
+	const theClock::time_point start = theClock::now();
+	for (int i = 0; i < connections; ++i) {
+		const int share = requests / connections + (i < requests % connections ? 1 : 0);
+		threads.emplace_back(client, port, i, share, maxZoom, &results[size_t(i)]);
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	const std::chrono::duration<double> elapsed = theClock::now() - start;
+
+	std::vector<double> latencies;
+	int ok = 0;
+	int busy = 0;
+	int failed = 0;
+	uint64_t bytes = 0;
+	for (const ClientResult& result : results) {
+		latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+		ok += result.ok;
+		busy += result.busy;
+		failed += result.failed;
+		bytes += result.bytes;
+	}
+	std::sort(latencies.begin(), latencies.end());
+
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << "Tiles: " << ok << " ok, " << busy << " busy (503), " << failed << " failed" << std::endl;
+	std::cout << "Time: " << elapsed.count() * 1000 << "ms, " << (ok + busy + failed) / elapsed.count() << " requests/s, "
+	          << bytes / (1024.0 * 1024.0) << "MB received" << std::endl;
+	std::cout << "Latency: p50 " << percentile(latencies, 50) << "ms, p90 " << percentile(latencies, 90) << "ms, p99 "
+	          << percentile(latencies, 99) << "ms, max " << (latencies.empty() ? 0.0 : latencies.back()) << "ms" << std::endl;
+
+	return failed > 0 ? 1 : 0;
+}
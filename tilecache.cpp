@@ -0,0 +1,210 @@
+#include "tilecache.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MANDELBROT_POSIX 1
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+const char cacheMagic[8] = { 'M', 'B', 'T', 'I', 'L', 'E', '0', '1' };
+const std::string cacheSuffix = ".tile";
+
+// FNV-1a, nothing clever, it only has to spread the keys over the file names
+static uint64_t hash_key(const std::string& key) {
+	uint64_t hash = 14695981039346656037ull;
+	for (const char c : key) {
+		hash ^= uint8_t(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// size of a tile's file: the magic, the key with its length, the size, the iterations and then the counts
+static uint64_t file_bytes(const std::string& key, int width, int height) {
+	return sizeof(cacheMagic) + sizeof(uint32_t) + key.size() + 2 * sizeof(int32_t) + sizeof(uint64_t)
+	       + uint64_t(width) * height * sizeof(uint32_t);
+}
+
+TileCache::TileCache(const std::string& directory, uint64_t capacityBytes)
+		: path(directory), capacity(capacityBytes), totalBytes(0), hits(0), misses(0), bytesRead(0), bytesWritten(0),
+		  iterationsSaved(0), evicted(0), tempCounter(0) {
+}
+
+bool TileCache::open() {
+#ifdef MANDELBROT_POSIX
+	if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+	DIR* dir = opendir(path.c_str());
+	if (dir == nullptr) {
+		return false;
+	}
+
+	// whatever the last runs left, oldest last, going by when each was last written or hit
+	struct Found {
+		time_t used;
+		std::string name;
+		uint64_t bytes;
+	};
+	std::vector<Found> found;
+	while (dirent* item = readdir(dir)) {
+		const std::string name = item->d_name;
+		if (name.size() <= cacheSuffix.size() || name.compare(name.size() - cacheSuffix.size(), cacheSuffix.size(), cacheSuffix) != 0) {
+			continue;
+		}
+		struct stat info;
+		if (stat((path + "/" + name).c_str(), &info) == 0 && S_ISREG(info.st_mode)) {
+			found.push_back({ info.st_mtime, name, uint64_t(info.st_size) });
+		}
+	}
+	closedir(dir);
+
+	std::stable_sort(found.begin(), found.end(), [](const Found& a, const Found& b) { return a.used > b.used; });
+
+	std::lock_guard<std::mutex> guard(lock);
+	for (const Found& file : found) {
+		entries.push_back({ file.name, file.bytes });
+		index[file.name] = std::prev(entries.end());
+		totalBytes += file.bytes;
+	}
+	evict(); // the cap might have come down since
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool TileCache::load(const std::string& key, Framebuffer& image, const Tile& tile) {
+	const int width = tile.x1 - tile.x0;
+	const int height = tile.y1 - tile.y0;
+	const std::string name = file_name(key);
+
+	std::ifstream in(path + "/" + name, std::ifstream::binary);
+	char magic[sizeof(cacheMagic)] = {};
+	uint32_t keyBytes = 0;
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(&keyBytes), sizeof(keyBytes));
+	if (!in || std::memcmp(magic, cacheMagic, sizeof(magic)) != 0 || keyBytes != key.size()) {
+		++misses;
+		return false;
+	}
+
+	// the same hash for a different key is a miss too
+	std::string storedKey(keyBytes, '\0');
+	int32_t storedWidth = 0;
+	int32_t storedHeight = 0;
+	uint64_t iterations = 0;
+	in.read(&storedKey[0], keyBytes);
+	in.read(reinterpret_cast<char*>(&storedWidth), sizeof(storedWidth));
+	in.read(reinterpret_cast<char*>(&storedHeight), sizeof(storedHeight));
+	in.read(reinterpret_cast<char*>(&iterations), sizeof(iterations));
+	if (!in || storedKey != key || storedWidth != width || storedHeight != height) {
+		++misses;
+		return false;
+	}
+
+	// straight into the tile's rows
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		in.read(reinterpret_cast<char*>(image.row(y) + tile.x0), std::streamsize(width) * sizeof(uint32_t));
+	}
+	if (!in) {
+		++misses; // cut short, the caller computes the tile over whatever got read
+		return false;
+	}
+
+#ifdef MANDELBROT_POSIX
+	utime((path + "/" + name).c_str(), nullptr); // so the next run knows it was used recently
+#endif
+	use(name, file_bytes(key, width, height));
+
+	++hits;
+	bytesRead += uint64_t(width) * height * sizeof(uint32_t);
+	iterationsSaved += iterations;
+	return true;
+}
+
+void TileCache::store(const std::string& key, const Framebuffer& image, const Tile& tile, uint64_t iterations) {
+	const int32_t width = tile.x1 - tile.x0;
+	const int32_t height = tile.y1 - tile.y0;
+	const std::string name = file_name(key);
+
+	// written under a name of its own and then renamed over the real one, so a run reading it at the same time
+	// (or after this one got killed halfway through) never sees half a tile
+	std::string temp = path + "/" + name + "." + std::to_string(tempCounter.fetch_add(1));
+#ifdef MANDELBROT_POSIX
+	temp += "." + std::to_string(getpid());
+#endif
+	temp += ".tmp";
+
+	std::ofstream out(temp, std::ofstream::binary);
+	const uint32_t keyBytes = uint32_t(key.size());
+	out.write(cacheMagic, sizeof(cacheMagic));
+	out.write(reinterpret_cast<const char*>(&keyBytes), sizeof(keyBytes));
+	out.write(key.data(), std::streamsize(key.size()));
+	out.write(reinterpret_cast<const char*>(&width), sizeof(width));
+	out.write(reinterpret_cast<const char*>(&height), sizeof(height));
+	out.write(reinterpret_cast<const char*>(&iterations), sizeof(iterations));
+	for (int y = tile.y0; y < tile.y1; ++y) {
+		out.write(reinterpret_cast<const char*>(image.row(y) + tile.x0), std::streamsize(width) * sizeof(uint32_t));
+	}
+	out.close();
+
+	// a full disk just means this tile doesn't get cached
+	if (!out || std::rename(temp.c_str(), (path + "/" + name).c_str()) != 0) {
+		std::remove(temp.c_str());
+		return;
+	}
+
+	const uint64_t bytes = file_bytes(key, width, height);
+	bytesWritten += bytes;
+	use(name, bytes);
+}
+
+CacheStats TileCache::stats() const {
+	return { hits.load(), misses.load(), bytesRead.load(), bytesWritten.load(), iterationsSaved.load(), evicted.load() };
+}
+
+uint64_t TileCache::sizeBytes() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return totalBytes;
+}
+
+std::string TileCache::file_name(const std::string& key) const {
+	char name[17];
+	std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash_key(key));
+	return name + cacheSuffix;
+}
+
+void TileCache::use(const std::string& name, uint64_t bytes) {
+	std::lock_guard<std::mutex> guard(lock);
+	auto found = index.find(name);
+	if (found != index.end()) {
+		totalBytes -= found->second->bytes;
+		entries.erase(found->second);
+	}
+	entries.push_front({ name, bytes });
+	index[name] = entries.begin();
+	totalBytes += bytes;
+	evict();
+}
+
+void TileCache::evict() {
+	while (totalBytes > capacity && !entries.empty()) {
+		const Entry& oldest = entries.back();
+		std::remove((path + "/" + oldest.name).c_str());
+		totalBytes -= oldest.bytes;
+		index.erase(oldest.name);
+		entries.pop_back();
+		++evicted;
+	}
+}
@@ -0,0 +1,76 @@
+// On-disk cache of iteration counts, one file per tile
+// Each tile is stored under a key that pins down everything its counts depend on (the region, the pixel spacing,
+// the resolution, MAX_IT, the fractal and its options and kernelVersion), with the file named after a hash of
+// the key and the key itself kept in the file so a collision can't hand back the wrong tile. The counts are kept
+// rather than colours, so the same tiles do for every colour. Once the files add up to more than the cap the
+// least recently used ones go (a hit touches the file, so the order carries over from one run to the next).
+
+#ifndef MANDELBROT_TILECACHE_H
+#define MANDELBROT_TILECACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "framebuffer.h"
+#include "scheduler.h"
+
+// what the cache did over a run
+struct CacheStats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bytesRead; // counts loaded from the cache instead of computed
+	uint64_t bytesWritten;
+	uint64_t iterationsSaved; // what the tiles that were hits took to compute the first time
+	uint64_t evicted;
+};
+
+class TileCache {
+public:
+	TileCache(const std::string& directory, uint64_t capacityBytes);
+
+	// makes the directory if it isn't there and reads what's already in it
+	// returns false if it can't be used (or this platform has no way of listing a directory)
+	bool open();
+
+	// fills the tile of image with the counts stored under key, false if they aren't there
+	bool load(const std::string& key, Framebuffer& image, const Tile& tile);
+
+	// keeps the tile's counts under key, iterations being what they took to compute
+	void store(const std::string& key, const Framebuffer& image, const Tile& tile, uint64_t iterations);
+
+	CacheStats stats() const;
+	uint64_t sizeBytes() const;
+	const std::string& directory() const { return path; }
+
+private:
+	struct Entry {
+		std::string name; // file name in the directory
+		uint64_t bytes;
+	};
+
+	std::string file_name(const std::string& key) const;
+	void use(const std::string& name, uint64_t bytes); // moves (or adds) an entry to the front
+	void evict(); // drops entries off the back until it's under the cap, needs lock held
+
+	std::string path;
+	uint64_t capacity;
+
+	mutable std::mutex lock; // for everything below apart from the counters
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> index;
+	uint64_t totalBytes;
+
+	std::atomic<uint64_t> hits;
+	std::atomic<uint64_t> misses;
+	std::atomic<uint64_t> bytesRead;
+	std::atomic<uint64_t> bytesWritten;
+	std::atomic<uint64_t> iterationsSaved;
+	std::atomic<uint64_t> evicted;
+	std::atomic<uint64_t> tempCounter; // keeps the names of files being written apart
+};
+
+#endif //MANDELBROT_TILECACHE_H
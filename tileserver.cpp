@@ -0,0 +1,393 @@
+#include "tileserver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MANDELBROT_POSIX 1
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+typedef std::chrono::steady_clock theClock;
+
+const size_t maxRequestBytes = 8192; // a request with more header than this isn't asking for a tile
+const int idleMs = 5000; // a kept-alive connection that sends nothing for this long gets closed
+const int pollMs = 200; // how long anything waiting on a socket goes before checking whether it's been told to stop
+const int backlogPerThread = 4; // connections allowed to wait for a connection thread, per connection thread
+
+#ifdef MANDELBROT_POSIX
+
+static std::atomic<bool> stopRequested(false);
+
+static void request_stop(int) {
+	stopRequested = true;
+}
+
+// a tile somebody's asked for, everyone else who asks for it before it's done waits for the same one
+struct PendingTile {
+	MapTile tile;
+	bool finished;
+	bool ok;
+	std::string body; // the encoded image
+};
+
+typedef std::tuple<int, int, int> TileKey;
+
+class TileServer {
+public:
+	TileServer(const ServerOptions& options, const MapRenderFn& render)
+			: options(options), render(render), stopping(false), renderStopping(false), stats() {
+	}
+
+	bool run(ServerStats& result);
+
+private:
+	void connection_worker();
+	void render_worker();
+	void handle(int fd);
+	void respond(int fd, const std::string& target, bool keepAlive);
+	std::shared_ptr<PendingTile> request_tile(const MapTile& tile);
+
+	const ServerOptions options;
+	const MapRenderFn render;
+
+	std::mutex lock; // for everything below
+	std::condition_variable connectionReady;
+	std::condition_variable jobReady;
+	std::condition_variable tileDone; // one for all the tiles, the waiters check their own
+	std::deque<int> connections; // accepted, waiting for a connection thread
+	std::deque<std::shared_ptr<PendingTile>> jobs; // waiting for a render thread
+	std::map<TileKey, std::shared_ptr<PendingTile>> inFlight; // queued or being rendered
+	bool stopping; // shutting down, no new tiles get queued
+	bool renderStopping; // every connection thread's gone, the render threads can go once the queue's empty
+	ServerStats stats;
+};
+
+// send() can send less than it was asked to, so keep going until it's all out
+static bool send_all(int fd, const char* data, size_t bytes) {
+	while (bytes > 0) {
+		const ssize_t sent = send(fd, data, bytes, 0);
+		if (sent <= 0) {
+			return false;
+		}
+		data += sent;
+		bytes -= size_t(sent);
+	}
+	return true;
+}
+
+static bool send_response(int fd, int status, const char* reason, const char* type, const std::string& body,
+                          bool keepAlive, const char* extraHeaders = "") {
+	std::ostringstream head;
+	head << "HTTP/1.1 " << status << " " << reason << "\r\n"
+	     << "Content-Type: " << type << "\r\n"
+	     << "Content-Length: " << body.size() << "\r\n"
+	     << "Access-Control-Allow-Origin: *\r\n" // the viewer's page usually comes from somewhere else
+	     << extraHeaders
+	     << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+	const std::string text = head.str();
+	return send_all(fd, text.data(), text.size()) && send_all(fd, body.data(), body.size());
+}
+
+static const char* content_type(OutputFormat format) {
+	return format == OutputFormat::PNG ? "image/png" : "image/x-tga";
+}
+
+bool TileServer::run(ServerStats& result) {
+	const int listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0) {
+		return false;
+	}
+	const int yes = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	// loopback only, this isn't meant to face the outside world
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(uint16_t(options.port));
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+		close(listener);
+		return false;
+	}
+
+	// Ctrl-C stops it tidily, and a client hanging up halfway through a tile shouldn't take the server down with it
+	stopRequested = false;
+	void (*oldInt)(int) = std::signal(SIGINT, request_stop);
+	void (*oldTerm)(int) = std::signal(SIGTERM, request_stop);
+	void (*oldPipe)(int) = std::signal(SIGPIPE, SIG_IGN);
+
+	std::vector<std::thread> renderThreads;
+	for (int i = 0; i < options.renderThreads; ++i) {
+		renderThreads.emplace_back(&TileServer::render_worker, this);
+	}
+	std::vector<std::thread> connectionThreads;
+	for (int i = 0; i < options.connectionThreads; ++i) {
+		connectionThreads.emplace_back(&TileServer::connection_worker, this);
+	}
+
+	const size_t backlog = size_t(options.connectionThreads) * backlogPerThread;
+	while (!stopRequested) {
+		pollfd waiting = { listener, POLLIN, 0 };
+		if (poll(&waiting, 1, pollMs) <= 0) {
+			continue;
+		}
+		const int fd = accept(listener, nullptr, nullptr);
+		if (fd < 0) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(lock);
+		if (connections.size() >= backlog) {
+			// every connection thread is busy and plenty are waiting already, better to say so than keep them hanging
+			++stats.rejected;
+			guard.unlock();
+			send_response(fd, 503, "Service Unavailable", "text/plain", "busy\n", false, "Retry-After: 1\r\n");
+			close(fd);
+			continue;
+		}
+		connections.push_back(fd);
+		guard.unlock();
+		connectionReady.notify_one();
+	}
+	close(listener);
+
+	// the connection threads finish the request they're on (and any connections still waiting get one each, a 503
+	// unless the tile's already queued), while the render threads keep going so nobody's left waiting for a tile...
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	connectionReady.notify_all();
+	for (auto& thread : connectionThreads) {
+		thread.join();
+	}
+
+	// ...then, with nobody left to queue anything, the render threads finish off the queue and go
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		renderStopping = true;
+	}
+	jobReady.notify_all();
+	for (auto& thread : renderThreads) {
+		thread.join();
+	}
+
+	std::signal(SIGINT, oldInt);
+	std::signal(SIGTERM, oldTerm);
+	std::signal(SIGPIPE, oldPipe);
+
+	result = stats;
+	return true;
+}
+
+void TileServer::connection_worker() {
+	while (true) {
+		std::unique_lock<std::mutex> guard(lock);
+		connectionReady.wait(guard, [this]() { return stopping || !connections.empty(); });
+		if (connections.empty()) {
+			return;
+		}
+		const int fd = connections.front();
+		connections.pop_front();
+		guard.unlock();
+
+		handle(fd);
+		close(fd);
+	}
+}
+
+void TileServer::handle(int fd) {
+	std::string buffer;
+	while (true) {
+		// read until there's a whole header, anything after it is the start of the next request
+		size_t headerEnd = buffer.find("\r\n\r\n");
+		int idle = 0;
+		while (headerEnd == std::string::npos) {
+			if (buffer.size() > maxRequestBytes) {
+				send_response(fd, 400, "Bad Request", "text/plain", "request too big\n", false);
+				return;
+			}
+			pollfd waiting = { fd, POLLIN, 0 };
+			const int ready = poll(&waiting, 1, pollMs);
+			if (ready == 0) {
+				idle += pollMs;
+				if (idle >= idleMs || stopRequested) {
+					return;
+				}
+				continue;
+			}
+			char chunk[2048];
+			const ssize_t got = ready > 0 ? recv(fd, chunk, sizeof(chunk), 0) : -1;
+			if (got <= 0) {
+				return; // hung up
+			}
+			buffer.append(chunk, size_t(got));
+			headerEnd = buffer.find("\r\n\r\n");
+		}
+
+		std::string header = buffer.substr(0, headerEnd);
+		buffer.erase(0, headerEnd + 4); // tile requests don't have a body
+		std::transform(header.begin(), header.end(), header.begin(), [](char c) { return char(std::tolower((unsigned char)c)); });
+
+		// "get /z/x/y.png http/1.1", lower case now but the path's only numbers
+		std::istringstream requestLine(header.substr(0, header.find("\r\n")));
+		std::string method;
+		std::string target;
+		std::string version;
+		requestLine >> method >> target >> version;
+
+		// 1.1 keeps the connection open unless it says otherwise, 1.0 only if it asks
+		bool keepAlive = version == "http/1.1" ? header.find("\r\nconnection: close") == std::string::npos
+		                                       : header.find("\r\nconnection: keep-alive") != std::string::npos;
+		keepAlive = keepAlive && !stopRequested;
+
+		if (method != "get") {
+			send_response(fd, 405, "Method Not Allowed", "text/plain", "only GET\n", false, "Allow: GET\r\n");
+			return;
+		}
+		respond(fd, target, keepAlive);
+		if (!keepAlive) {
+			return;
+		}
+	}
+}
+
+void TileServer::respond(int fd, const std::string& target, bool keepAlive) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		++stats.requests;
+	}
+
+	if (target == "/stats") {
+		std::ostringstream text;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			text << "requests " << stats.requests << "\nrendered " << stats.rendered << "\ncoalesced " << stats.coalesced
+			     << "\nrejected " << stats.rejected << "\nqueued " << jobs.size() << "\nin flight " << inFlight.size() << "\n";
+		}
+		send_response(fd, 200, "OK", "text/plain", text.str(), keepAlive, "Cache-Control: no-store\r\n");
+		return;
+	}
+
+	// /z/x/y with the format's extension (or none)
+	MapTile tile = {};
+	int used = 0;
+	const bool parsed = std::sscanf(target.c_str(), "/%d/%d/%d%n", &tile.z, &tile.x, &tile.y, &used) == 3;
+	const std::string rest = parsed ? target.substr(size_t(used)) : "";
+	const bool valid = parsed && (rest.empty() || rest == format_extension(options.format))
+	                   && tile.z >= 0 && tile.z <= options.maxZoom
+	                   && tile.x >= 0 && tile.y >= 0 && tile.x < (1 << tile.z) && tile.y < (1 << tile.z);
+	if (!valid) {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			++stats.notFound;
+		}
+		send_response(fd, 404, "Not Found", "text/plain", "no such tile\n", keepAlive);
+		return;
+	}
+
+	const std::shared_ptr<PendingTile> pending = request_tile(tile);
+	if (!pending) {
+		send_response(fd, 503, "Service Unavailable", "text/plain", "busy\n", keepAlive, "Retry-After: 1\r\n");
+		return;
+	}
+	if (!pending->ok) {
+		send_response(fd, 500, "Internal Server Error", "text/plain", "couldn't render the tile\n", keepAlive);
+		return;
+	}
+
+	// the tiles never change while the server's up, so the browser can hang on to them
+	if (send_response(fd, 200, "OK", content_type(options.format), pending->body, keepAlive, "Cache-Control: max-age=3600\r\n")) {
+		std::lock_guard<std::mutex> guard(lock);
+		stats.bytesSent += pending->body.size();
+	}
+}
+
+// queues the tile (unless it's queued already) and waits for it, nullptr if the queue's full or the server's stopping
+std::shared_ptr<PendingTile> TileServer::request_tile(const MapTile& tile) {
+	std::unique_lock<std::mutex> guard(lock);
+	const TileKey key(tile.z, tile.x, tile.y);
+
+	std::shared_ptr<PendingTile> pending;
+	auto found = inFlight.find(key);
+	if (found != inFlight.end()) {
+		pending = found->second;
+		++stats.coalesced;
+	} else {
+		if (stopping || jobs.size() >= size_t(options.maxQueued)) {
+			++stats.rejected;
+			return nullptr;
+		}
+		pending = std::make_shared<PendingTile>();
+		pending->tile = tile;
+		pending->finished = false;
+		pending->ok = false;
+		inFlight[key] = pending;
+		jobs.push_back(pending);
+		jobReady.notify_one();
+	}
+
+	tileDone.wait(guard, [&pending]() { return pending->finished; });
+	return pending;
+}
+
+void TileServer::render_worker() {
+	Framebuffer image(mapTileSize, mapTileSize, false);
+	while (true) {
+		std::unique_lock<std::mutex> guard(lock);
+		jobReady.wait(guard, [this]() { return renderStopping || !jobs.empty(); });
+		if (jobs.empty()) {
+			return;
+		}
+		const std::shared_ptr<PendingTile> pending = jobs.front();
+		jobs.pop_front();
+		guard.unlock();
+
+		// the SIMD kernels already keep this thread busy, so the tile's drawn and encoded on it alone
+		const theClock::time_point start = theClock::now();
+		std::ostringstream encoded;
+		const bool ok = render(pending->tile, image) && encode_image(encoded, image, options.format, 1);
+		const std::chrono::duration<double> taken = theClock::now() - start;
+
+		guard.lock();
+		pending->ok = ok;
+		pending->body = encoded.str();
+		pending->finished = true;
+		inFlight.erase(TileKey(pending->tile.z, pending->tile.x, pending->tile.y));
+		++stats.rendered;
+		stats.renderSeconds += taken.count();
+		guard.unlock();
+		tileDone.notify_all();
+	}
+}
+
+bool serve_tiles(const ServerOptions& options, const MapRenderFn& render, ServerStats& stats) {
+	TileServer server(options, render);
+	return server.run(stats);
+}
+
+#else
+
+bool serve_tiles(const ServerOptions&, const MapRenderFn&, ServerStats&) {
+	return false; // no sockets here yet
+}
+
+#endif
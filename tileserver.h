@@ -0,0 +1,55 @@
+// Slippy map tile server
+// A small HTTP server on the loopback interface that hands out tiles of the fractal as /z/x/y.png, the way web map
+// viewers (Leaflet, OpenLayers) ask for them: zoom 0 is the whole map in one tile and every zoom level doubles the
+// tiles each way. Connections are read by their own threads and the tiles are rendered by a fixed pool of render
+// threads. A tile that's already being rendered isn't rendered again, anyone else who asks for it waits for the same
+// one, and once too many tiles are waiting to be rendered new ones get a 503 straight away rather than piling up.
+
+#ifndef MANDELBROT_TILESERVER_H
+#define MANDELBROT_TILESERVER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "encode.h"
+#include "framebuffer.h"
+
+const int mapTileSize = 256; // pixels each way, what the viewers expect
+
+// a tile's place in the map, x to the right and y down from the top left
+struct MapTile {
+	int z;
+	int x;
+	int y;
+};
+
+// draws one tile into image (mapTileSize square), called from the render threads so it has to be safe to run on
+// several at once, returns false if the tile can't be drawn (too deep, say)
+typedef std::function<bool(const MapTile& tile, Framebuffer& image)> MapRenderFn;
+
+struct ServerOptions {
+	int port;
+	int renderThreads;
+	int connectionThreads; // connections being read from at once, more than this wait to be picked up
+	int maxQueued; // tiles waiting for a render thread before new ones get turned away
+	int maxZoom;
+	OutputFormat format; // PNG if the build has it, the viewers can't do anything with a TGA
+};
+
+// what the server did, printed when it shuts down
+struct ServerStats {
+	uint64_t requests;
+	uint64_t rendered;
+	uint64_t coalesced; // requests that got a tile someone else had already asked for
+	uint64_t rejected; // 503s, the queue or the connection backlog was full
+	uint64_t notFound;
+	uint64_t bytesSent;
+	double renderSeconds; // summed over the render threads
+};
+
+// serves tiles on 127.0.0.1:port until SIGINT or SIGTERM, then finishes what it's doing and returns
+// returns false if it couldn't start (the port's taken, or no sockets on this platform)
+bool serve_tiles(const ServerOptions& options, const MapRenderFn& render, ServerStats& stats);
+
+#endif //MANDELBROT_TILESERVER_H
@@ -0,0 +1,94 @@
+#include "trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+struct Event {
+	const char* name;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::steady_clock::time_point end;
+};
+
+// one per thread that's recorded anything, only that thread ever adds to it
+struct ThreadBuffer {
+	int id;
+	std::vector<Event> events;
+};
+
+std::mutex buffersLock; // only for adding a buffer to the list and for the dump
+std::vector<std::unique_ptr<ThreadBuffer>> buffers; // kept here so the events outlive the threads
+std::chrono::steady_clock::time_point origin;
+
+thread_local ThreadBuffer* threadBuffer = nullptr;
+
+ThreadBuffer& buffer() {
+	if (threadBuffer == nullptr) {
+		std::lock_guard<std::mutex> guard(buffersLock);
+		buffers.emplace_back(new ThreadBuffer { int(buffers.size()), {} });
+		threadBuffer = buffers.back().get();
+		threadBuffer->events.reserve(4096); // enough for a normal render's tiles without growing
+	}
+	return *threadBuffer;
+}
+
+// a JSON string, the names are all our own but this keeps the file valid whatever they are
+void write_string(std::ofstream& out, const char* text) {
+	out << '"';
+	for (const char* c = text; *c != '\0'; ++c) {
+		if (*c == '"' || *c == '\\') {
+			out << '\\';
+		}
+		out << *c;
+	}
+	out << '"';
+}
+
+double microseconds(std::chrono::steady_clock::duration duration) {
+	return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}
+
+std::atomic<bool> trace_detail::enabled(false);
+
+void trace_detail::record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	buffer().events.push_back({ name, start, end });
+}
+
+void trace_start() {
+	{
+		std::lock_guard<std::mutex> guard(buffersLock);
+		origin = std::chrono::steady_clock::now();
+	}
+	trace_detail::enabled.store(true);
+}
+
+bool trace_write(const std::string& file) {
+	std::ofstream out(file);
+	out << std::fixed << std::setprecision(3); // microseconds, to the nanosecond
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	std::lock_guard<std::mutex> guard(buffersLock);
+	bool first = true;
+	for (const auto& thread : buffers) {
+		// name the threads so the viewer doesn't just show numbers
+		out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id
+		    << ",\"args\":{\"name\":\"thread " << thread->id << "\"}}";
+		first = false;
+
+		for (const Event& event : thread->events) {
+			out << ",\n{\"name\":";
+			write_string(out, event.name);
+			out << ",\"cat\":\"mandelbrot\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id
+			    << ",\"ts\":" << microseconds(event.start - origin) << ",\"dur\":" << microseconds(event.end - event.start) << "}";
+		}
+	}
+	out << "\n]}\n";
+	out.close();
+	return bool(out);
+}
@@ -0,0 +1,54 @@
+// Timeline of what every thread was doing, for chrome://tracing or Perfetto
+// A TraceScope records a begin and end time for whatever it wraps into a buffer that belongs to the thread it's on,
+// so nothing is locked while the render is going (each thread takes a lock once, the first time it records anything,
+// to hand its buffer over to the list the dump reads). When tracing hasn't been switched on a scope is one relaxed
+// atomic load and a branch. The names have to be string literals (or otherwise outlive the trace), only the pointer
+// is kept.
+
+#ifndef MANDELBROT_TRACE_H
+#define MANDELBROT_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace trace_detail {
+extern std::atomic<bool> enabled;
+
+void record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+}
+
+// starts recording, anything before this isn't in the trace
+void trace_start();
+
+inline bool trace_enabled() {
+	return trace_detail::enabled.load(std::memory_order_relaxed);
+}
+
+// Writes everything recorded so far as trace event JSON. Only call it while nothing is being traced (between renders),
+// returns false if the file couldn't be written.
+bool trace_write(const std::string& file);
+
+class TraceScope {
+public:
+	explicit TraceScope(const char* name) : name(trace_enabled() ? name : nullptr) {
+		if (this->name != nullptr) {
+			start = std::chrono::steady_clock::now();
+		}
+	}
+
+	~TraceScope() {
+		if (name != nullptr) {
+			trace_detail::record(name, start, std::chrono::steady_clock::now());
+		}
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name; // nullptr when tracing's off
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif //MANDELBROT_TRACE_H
@@ -0,0 +1,125 @@
+// Framebuffer traffic benchmark
+// Does the same writes as compute() but without any Mandelbrot maths, so all that's left to measure is
+// how the traversal order and the way the image is split up between threads affect memory traffic
+//
+// usage: traversal_bench [width] [height] [threads] [repetitions]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.h"
+#include "scheduler.h"
+
+typedef std::chrono::steady_clock theClock;
+
+const int linePixels = Framebuffer::linePixels;
+const int tileSize = 64;
+
+// writes a tile column by column (old order) or row by row (new order)
+void fill_tile(Framebuffer& image, const Tile& tile, bool columns) {
+	if (columns) {
+		for (int x = tile.x0; x < tile.x1; ++x) {
+			for (int y = tile.y0; y < tile.y1; ++y) {
+				image.row(y)[x] = uint32_t(x ^ y);
+			}
+		}
+	} else {
+		for (int y = tile.y0; y < tile.y1; ++y) {
+			uint32_t* row = image.row(y);
+			for (int x = tile.x0; x < tile.x1; ++x) {
+				row[x] = uint32_t(x ^ y);
+			}
+		}
+	}
+}
+
+void bench_worker(TileScheduler* scheduler, int worker, Framebuffer* image, bool columns) {
+	Tile tile = {};
+	while (scheduler->next(worker, tile)) {
+		fill_tile(*image, tile, columns);
+	}
+}
+
+// counts the cache lines that more than one tile writes into, i.e. the ones that can bounce between threads
+long long shared_lines(int threads, int width, int height, Partition partition) {
+	TileScheduler scheduler(threads, width, height, tileSize, partition, linePixels);
+	long long shared = 0;
+	Tile tile = {};
+	while (scheduler.next(0, tile)) {
+		if (tile.x0 % linePixels != 0) {
+			shared += tile.y1 - tile.y0; // the line holding the left edge is split with the tile next door, on every row
+		}
+	}
+	return shared;
+}
+
+int main(int argc, char* argv[]) {
+	const int width = argc > 1 ? std::atoi(argv[1]) : 8192;
+	const int height = argc > 2 ? std::atoi(argv[2]) : 8192;
+	const int threads = argc > 3 ? std::atoi(argv[3]) : std::max(1, int(std::thread::hardware_concurrency()));
+	const int reps = argc > 4 ? std::atoi(argv[4]) : 5;
+
+	if (width <= 0 || height <= 0 || threads <= 0 || reps <= 0) {
+		std::cout << "usage: traversal_bench [width] [height] [threads] [repetitions]" << std::endl;
+		return 1;
+	}
+
+	// same framebuffer as the real thing, rows padded out to whole cache lines
+	Framebuffer image(width, height);
+
+	const double bytes = double(width) * height * sizeof(uint32_t);
+	std::cout << "Framebuffer " << width << "*" << height << " (" << bytes / (1024 * 1024) << " MB"
+	          << (image.hugePages() ? ", huge pages" : "") << "), "
+	          << threads << " threads, best of " << reps << std::endl;
+
+	struct Mode {
+		const char* name;
+		Partition partition;
+		bool columns;
+	};
+	const Mode modes[] = {
+		{ "strips + columns (original)", Partition::Strips, true },
+		{ "strips + rows", Partition::Strips, false },
+		{ "tiles + columns", Partition::Tiles, true },
+		{ "tiles + rows (default)", Partition::Tiles, false },
+	};
+
+	std::cout << std::left << std::setw(30) << "mode" << std::right << std::setw(12) << "best ms"
+	          << std::setw(12) << "GB/s" << std::setw(16) << "shared lines" << std::endl;
+
+	for (const Mode& mode : modes) {
+		long long best = -1;
+		for (int rep = 0; rep < reps; ++rep) {
+			TileScheduler scheduler(threads, width, height, tileSize, mode.partition, linePixels);
+
+			theClock::time_point start = theClock::now();
+			std::vector<std::thread> workers;
+			for (int i = 0; i < threads; ++i) {
+				workers.emplace_back(bench_worker, &scheduler, i, &image, mode.columns);
+			}
+			for (auto& worker : workers) {
+				worker.join();
+			}
+			theClock::time_point end = theClock::now();
+
+			const long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+			if (best < 0 || us < best) {
+				best = us;
+			}
+		}
+
+		std::cout << std::left << std::setw(30) << mode.name << std::right << std::fixed << std::setprecision(2)
+		          << std::setw(12) << best / 1000.0
+		          << std::setw(12) << bytes / (double(best) * 1000.0)
+		          << std::setw(16) << shared_lines(threads, width, height, mode.partition) << std::endl;
+	}
+
+	return 0;
+}